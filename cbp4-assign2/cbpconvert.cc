@@ -0,0 +1,219 @@
+// Converts a CBP4 trace (gzip, raw or columnar) into the columnar format
+// of columnar.h, or back into raw 10-byte records.
+//
+// usage: cbpconvert <trace> <out.cbpc>
+//        cbpconvert --raw <trace> <out>
+
+#include "utils.h"
+#include "tracer.h"
+#include "columnar.h"
+
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+
+static void PutBits(std::vector<UINT8> &out, const std::vector<bool> &bits){
+  out.assign((bits.size() + 7) / 8, 0);
+  for(size_t i = 0; i < bits.size(); i++){
+    out[i >> 3] |= (UINT8) bits[i] << (i & 7);
+  }
+}
+
+static bool ByCount(const std::pair<UINT32, UINT32> &a, const std::pair<UINT32, UINT32> &b){
+  return (a.second != b.second) ? a.second > b.second : a.first < b.first;
+}
+
+// appends one chunk (header and columns) to out
+static void EncodeChunk(const std::vector<CBP_TRACE_RECORD> &recs, std::vector<UINT8> &out){
+  CBPC_CHUNK_HEADER hdr;
+  std::vector<UINT8> col[CBPC_NUM_COLS];
+  std::vector<bool> taken;
+
+  // static branches in order of first appearance, with their targets
+  // ordered by how often they occur in the chunk
+  std::unordered_map<UINT32, UINT32> staticId;
+  std::vector<UINT32> staticPC;
+  std::vector< std::unordered_map<UINT32, UINT32> > targetCount;
+  std::vector< std::unordered_map<UINT32, UINT32> > targetCode;
+
+  for(size_t i = 0; i < recs.size(); i++){
+    if(!CbpcIsBranch(recs[i].opType)) continue;
+    std::unordered_map<UINT32, UINT32>::iterator it = staticId.find(recs[i].PC);
+    if(it == staticId.end()){
+      it = staticId.insert(std::make_pair(recs[i].PC, (UINT32) staticPC.size())).first;
+      staticPC.push_back(recs[i].PC);
+      targetCount.resize(staticPC.size());
+    }
+    targetCount[it->second][recs[i].branchTarget]++;
+  }
+
+  UINT32 prevPC = 0;
+  targetCode.resize(staticPC.size());
+  for(size_t s = 0; s < staticPC.size(); s++){
+    std::vector< std::pair<UINT32, UINT32> > targets(targetCount[s].begin(), targetCount[s].end());
+    std::sort(targets.begin(), targets.end(), ByCount);
+
+    CbpcPutVarint(col[CBPC_COL_STATIC], CbpcZigZag(staticPC[s] - prevPC));
+    CbpcPutVarint(col[CBPC_COL_STATIC], targets.size());
+    for(size_t t = 0; t < targets.size(); t++){
+      CbpcPutVarint(col[CBPC_COL_STATIC], CbpcZigZag(targets[t].first - staticPC[s]));
+      targetCode[s][targets[t].first] = t;
+    }
+    prevPC = staticPC[s];
+  }
+
+  // per-branch and per-record columns
+  UINT32 nextPos = 0, numBranches = 0, numExceptions = 0;
+
+  col[CBPC_COL_OPTYPE].assign((recs.size() + 1) / 2, 0);
+  prevPC = 0;
+  for(size_t i = 0; i < recs.size(); i++){
+    const CBP_TRACE_RECORD &r = recs[i];
+
+    col[CBPC_COL_OPTYPE][i >> 1] |= (UINT8) (r.opType << ((i & 1) * 4));
+
+    if(CbpcIsBranch(r.opType)){
+      UINT32 s = staticId[r.PC];
+      CbpcPutVarint(col[CBPC_COL_GAP], i - nextPos);
+      CbpcPutVarint(col[CBPC_COL_ID], s);
+      taken.push_back(r.branchTaken);
+      if(targetCount[s].size() > 1){
+        CbpcPutVarint(col[CBPC_COL_TARGET], targetCode[s][r.branchTarget]);
+      }
+      nextPos = i + 1;
+      numBranches++;
+    }
+    else{
+      CbpcPutVarint(col[CBPC_COL_PC], CbpcZigZag(r.PC - prevPC));
+      if(r.branchTarget != r.PC || r.branchTaken){
+        UINT8 bytes[5];
+        memcpy(bytes, &r.branchTarget, 4);
+        bytes[4] = r.branchTaken;
+        CbpcPutVarint(col[CBPC_COL_EXCEPT], i);
+        col[CBPC_COL_EXCEPT].insert(col[CBPC_COL_EXCEPT].end(), bytes, bytes + 5);
+        numExceptions++;
+      }
+    }
+    prevPC = r.PC;
+  }
+  PutBits(col[CBPC_COL_TAKEN], taken);
+
+  hdr.numRecords = recs.size();
+  hdr.numBranches = numBranches;
+  hdr.numStatic = staticPC.size();
+  hdr.numExceptions = numExceptions;
+  for(int c = 0; c < CBPC_NUM_COLS; c++){
+    hdr.colBytes[c] = col[c].size();
+  }
+
+  const UINT8 *h = (const UINT8 *) &hdr;
+  out.insert(out.end(), h, h + sizeof(hdr));
+  for(int c = 0; c < CBPC_NUM_COLS; c++){
+    out.insert(out.end(), col[c].begin(), col[c].end());
+  }
+}
+
+/////////////////////////////////////////////////////////////
+
+static int Convert(char *in, const char *outName){
+  CBP_TRACER *tracer = new CBP_TRACER(in);
+  CBP_TRACE_RECORD rec;
+  std::vector<CBP_TRACE_RECORD> recs;
+  std::vector<UINT64> offsets;
+  std::vector<UINT8> chunk;
+  CBPC_FILE_HEADER header;
+  UINT64 pos = sizeof(header);
+  FILE *out;
+
+  if((out = fopen(outName, "wb")) == NULL){
+    printf("Unable to open %s\n", outName);
+    return -1;
+  }
+
+  memset(&header, 0, sizeof(header));
+  fwrite(&header, sizeof(header), 1, out);
+  tracer->SetHeartBeat(false);
+
+  bool more = true;
+  while(more){
+    more = tracer->GetNextRecord(&rec);
+    if(more){
+      recs.push_back(rec);
+    }
+    if(recs.size() == CBPC_CHUNK_RECORDS || (!more && !recs.empty())){
+      chunk.clear();
+      EncodeChunk(recs, chunk);
+      fwrite(&chunk[0], chunk.size(), 1, out);
+      offsets.push_back(pos);
+      pos += chunk.size();
+      recs.clear();
+    }
+  }
+
+  memcpy(header.magic, CBPC_MAGIC, 8);
+  header.chunkRecords = CBPC_CHUNK_RECORDS;
+  header.numChunks = offsets.size();
+  header.numRecords = tracer->GetNumInst();
+  header.dirOffset = pos;
+  if(!offsets.empty()){
+    fwrite(&offsets[0], 8, offsets.size(), out);
+  }
+  rewind(out);
+  fwrite(&header, sizeof(header), 1, out);
+
+  if(fclose(out) != 0){
+    printf("Unable to write %s\n", outName);
+    return -1;
+  }
+
+  UINT64 bytes = pos + offsets.size() * 8;
+  printf("%llu records, %llu bytes (%.3f bytes/record, raw %d)\n",
+	 header.numRecords, bytes, (double) bytes / (header.numRecords ? header.numRecords : 1),
+	 CBP_RECORD_SIZE);
+  delete tracer;
+  return 0;
+}
+
+static int ToRaw(char *in, const char *outName){
+  CBP_TRACER *tracer = new CBP_TRACER(in);
+  CBP_TRACE_RECORD rec;
+  UINT8 bytes[CBP_RECORD_SIZE];
+  FILE *out;
+
+  if((out = fopen(outName, "wb")) == NULL){
+    printf("Unable to open %s\n", outName);
+    return -1;
+  }
+
+  tracer->SetHeartBeat(false);
+  while(tracer->GetNextRecord(&rec)){
+    memcpy(bytes, &rec.PC, 4);
+    memcpy(bytes + 4, &rec.branchTarget, 4);
+    bytes[8] = rec.opType;
+    bytes[9] = rec.branchTaken;
+    fwrite(bytes, CBP_RECORD_SIZE, 1, out);
+  }
+
+  if(fclose(out) != 0){
+    printf("Unable to write %s\n", outName);
+    return -1;
+  }
+  delete tracer;
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  if(argc == 4 && strcmp(argv[1], "--raw") == 0){
+    return ToRaw(argv[2], argv[3]);
+  }
+  if(argc == 3){
+    return Convert(argv[1], argv[2]);
+  }
+
+  printf("usage: %s <trace> <out.cbpc>\n", argv[0]);
+  printf("       %s --raw <trace> <out>\n", argv[0]);
+  return -1;
+}
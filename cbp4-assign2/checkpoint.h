@@ -0,0 +1,61 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include "utils.h"
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+// predictor state checkpoints
+/////////////////////////////////////////////////////////////
+
+// CHECKPOINT moves predictor state to or from a file. A predictor lists
+// its state once, in a Checkpoint(CHECKPOINT &) method, and the same code
+// saves or restores it depending on the direction the CHECKPOINT was
+// opened in. Sizes are fixed by the predictor's configuration, so a
+// restore into a differently configured predictor fails instead of
+// reading past its tables. Ok() is false after the first failure.
+
+class CHECKPOINT{
+ private:
+  FILE *fp;
+  bool  saving;
+  bool  ok;
+
+ public:
+  CHECKPOINT(FILE *file, bool save){
+    fp = file;
+    saving = save;
+    ok = (file != NULL);
+  }
+
+  bool Saving() const { return saving; }
+  bool Ok() const { return ok; }
+  void Fail(){ ok = false; }
+
+  void IO(void *data, size_t bytes){
+    if (!ok || bytes == 0) return;
+    ok = saving ? fwrite(data, bytes, 1, fp) == 1 : fread(data, bytes, 1, fp) == 1;
+  }
+
+  // plain values, arrays of them and the POD history classes
+  template <class T>
+  void Value(T &v){ IO(&v, sizeof(v)); }
+
+  template <class T>
+  void Vector(std::vector<T> &v){
+    UINT64 n = v.size();
+    Value(n);
+    if (n != v.size()) ok = false;
+    if (n > 0) IO(&v[0], n * sizeof(T));
+  }
+
+  void String(std::string &str){
+    UINT32 n = str.size();
+    Value(n);
+    if (!ok) return;
+    if (!saving) str.resize(n);
+    if (n > 0) IO(&str[0], n);
+  }
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _COLUMNAR_H_
+#define _COLUMNAR_H_
+
+#include "utils.h"
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+// columnar trace format (.cbpc)
+/////////////////////////////////////////////////////////////
+
+// A re-encoding of the 10-byte CBP4 records, written by cbpconvert and
+// read by CBP_TRACER. The file is a header, chunks of up to chunkRecords
+// records each, and a directory with the file offset of every chunk.
+// Chunks are self-contained, so a seek decodes only the chunk it lands in.
+//
+// A branch is any control transfer (opType >= OPTYPE_CALL_DIRECT). Each
+// chunk stores its columns one after the other, branches first:
+//
+//   STATIC   one entry per static branch of the chunk: PC (zigzag delta
+//            from the previous entry), number of distinct targets, the
+//            targets (zigzag delta from the PC), most frequent first
+//   GAP      per branch: records since the previous branch
+//   ID       per branch: its static branch
+//   TAKEN    per branch: one bit
+//   TARGET   per branch of a static branch with more than one target:
+//            index into that branch's targets
+//   OPTYPE   per record: 4 bits
+//   PC       per non-branch record: zigzag delta from the previous PC
+//   EXCEPT   non-branch records whose target is not their PC or that are
+//            marked taken: position, target, taken
+//
+// Numbers are LEB128 varints. A reader that only needs the branches
+// stops after TARGET and looks up the opType of each branch in OPTYPE.
+
+#define CBPC_MAGIC           "CBPCOL1"
+#define CBPC_CHUNK_RECORDS   (1 << 16)
+
+enum{
+  CBPC_COL_STATIC = 0,
+  CBPC_COL_GAP,
+  CBPC_COL_ID,
+  CBPC_COL_TAKEN,
+  CBPC_COL_TARGET,
+  CBPC_COL_OPTYPE,
+  CBPC_COL_PC,
+  CBPC_COL_EXCEPT,
+  CBPC_NUM_COLS
+};
+
+struct CBPC_FILE_HEADER{
+  char   magic[8];
+  UINT32 chunkRecords;
+  UINT32 numChunks;
+  UINT64 numRecords;
+  UINT64 dirOffset;      // UINT64 file offset of each chunk
+};
+
+struct CBPC_CHUNK_HEADER{
+  UINT32 numRecords;
+  UINT32 numBranches;
+  UINT32 numStatic;
+  UINT32 numExceptions;
+  UINT32 colBytes[CBPC_NUM_COLS];
+};
+
+static inline void CbpcPutVarint(std::vector<UINT8> &out, UINT64 v)
+{
+  while (v >= 0x80) {
+    out.push_back((UINT8) (v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((UINT8) v);
+}
+
+static inline UINT64 CbpcGetVarint(const UINT8 *&p)
+{
+  UINT64 v = 0;
+  int    shift = 0;
+
+  while (*p & 0x80) {
+    v |= (UINT64) (*p++ & 0x7f) << shift;
+    shift += 7;
+  }
+  return v | ((UINT64) *p++ << shift);
+}
+
+// signed 32-bit deltas as small unsigned numbers
+static inline UINT32 CbpcZigZag(UINT32 delta)
+{
+  return (delta << 1) ^ (UINT32) ((INT32) delta >> 31);
+}
+
+static inline UINT32 CbpcUnZigZag(UINT32 v)
+{
+  return (v >> 1) ^ (0 - (v & 1));
+}
+
+static inline bool CbpcIsBranch(UINT32 opType)
+{
+  return opType >= 3;    // OPTYPE_CALL_DIRECT and up
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include "utils.h"
+#include <string.h>
+
+/////////////////////////////////////////////////////////////
+// global history
+/////////////////////////////////////////////////////////////
+
+// HistoryRegister<MaxBits> is a global history of up to MaxBits outcomes
+// kept as a circular bit buffer in 64-bit words, so pushing an outcome
+// costs the same for 16 bits of history as for 4096. Bit(0) is the newest
+// outcome, Bit(MaxBits-1) the oldest one still held. The newest 64
+// outcomes are also kept in a plain shift register for short-history
+// indexing.
+
+template <UINT32 MaxBits>
+class HistoryRegister{
+ public:
+  // room for MaxBits plus the bit that is just leaving, rounded up to words
+  static const UINT32 WORDS = (MaxBits + 1 + 63) / 64;
+  static const UINT32 SIZE = WORDS * 64;
+
+ private:
+  UINT64 words[WORDS];
+  UINT32 head;           // position of the newest bit
+  UINT64 recent;         // newest 64 outcomes, newest in bit 0
+
+ public:
+  HistoryRegister(){ Clear(); }
+
+  void Clear(){
+    memset(words, 0, sizeof(words));
+    head = 0;
+    recent = 0;
+  }
+
+  void Push(bool taken){
+    head = (head == 0) ? SIZE - 1 : head - 1;
+    UINT64 mask = (UINT64) 1 << (head & 63);
+    words[head >> 6] = (words[head >> 6] & ~mask) | ((UINT64) taken << (head & 63));
+    recent = (recent << 1) | (UINT64) taken;
+  }
+
+  // i-th most recent outcome, 0 <= i <= MaxBits
+  bool Bit(UINT32 i) const {
+    UINT32 pos = head + i;
+    if (pos >= SIZE) pos -= SIZE;
+    return (words[pos >> 6] >> (pos & 63)) & 1;
+  }
+
+  // newest n outcomes (n <= 64), newest in bit 0
+  UINT64 Recent(UINT32 n) const {
+    return (n >= 64) ? recent : recent & (((UINT64) 1 << n) - 1);
+  }
+};
+
+/////////////////////////////////////////////////////////////
+
+// FoldedHistory compresses the newest origLength outcomes of a history
+// register into compLength bits by XOR-folding, and keeps the fold up to
+// date in O(1) per outcome: after each Push() on the register, Update()
+// shifts the new outcome in and cancels the one that just fell out of the
+// window. This is the usual way TAGE-style predictors hash histories of
+// hundreds or thousands of bits into a table index or tag.
+
+class FoldedHistory{
+ private:
+  UINT32 comp;
+  UINT32 compLength;
+  UINT32 origLength;
+  UINT32 outPoint;
+
+ public:
+  FoldedHistory(){ Init(0, 1); }
+
+  void Init(UINT32 originalLength, UINT32 compressedLength){
+    comp = 0;
+    origLength = originalLength;
+    compLength = compressedLength;
+    outPoint = (compLength > 0) ? origLength % compLength : 0;
+  }
+
+  UINT32 Value() const { return comp; }
+
+  template <UINT32 MaxBits>
+  void Update(const HistoryRegister<MaxBits> &h){
+    comp = (comp << 1) | (UINT32) h.Bit(0);
+    comp ^= (UINT32) h.Bit(origLength) << outPoint;
+    comp ^= comp >> compLength;
+    comp &= (1u << compLength) - 1;
+  }
+};
+
+/////////////////////////////////////////////////////////////
+
+// Skewing functions for skewed (multi-bank) predictors: H is a one-bit
+// rotate right that feeds back the XOR of the end bits, Hinv its inverse.
+// Both act on the low n bits of v.
+
+static inline UINT32 SkewH(UINT32 v, UINT32 n)
+{
+  UINT32 top = ((v >> (n - 1)) ^ v) & 1;
+  return (v >> 1) | (top << (n - 1));
+}
+
+static inline UINT32 SkewHinv(UINT32 v, UINT32 n)
+{
+  UINT32 low = ((v >> (n - 1)) ^ (v >> (n - 2))) & 1;
+  return ((v << 1) & ((1u << n) - 1)) | low;
+}
+
+#endif
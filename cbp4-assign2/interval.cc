@@ -0,0 +1,219 @@
+#include "interval.h"
+#include <math.h>
+
+/////////////////////////////////////////////////////////////
+// interval MPKI time series
+/////////////////////////////////////////////////////////////
+
+#define INTERVAL_KMEANS_ROUNDS	100
+
+INTERVAL_SERIES::INTERVAL_SERIES(UINT32 numPredictors, UINT64 baseInst)
+{
+	numPreds = numPredictors;
+	base = baseInst;
+	lastEnd = 0;
+	lastCondBranch = 0;
+	lastMispred.assign(numPreds, 0);
+}
+
+void INTERVAL_SERIES::Sample(UINT64 end, UINT64 numCondBranch, const std::vector<UINT64> &numMispred)
+{
+	if (end <= lastEnd)
+		return;
+
+	start.push_back(base + lastEnd);
+	length.push_back(end - lastEnd);
+	condBranch.push_back(numCondBranch - lastCondBranch);
+	for (UINT32 p = 0; p < numPreds; p++) {
+		mispred.push_back(numMispred[p] - lastMispred[p]);
+		lastMispred[p] = numMispred[p];
+	}
+	lastEnd = end;
+	lastCondBranch = numCondBranch;
+}
+
+void INTERVAL_SERIES::WriteCsv(FILE *out, const char *traceName, bool header,
+			       const std::vector<const char *> &specs) const
+{
+	if (header) {
+		fprintf(out, "trace,start,instructions,cond_branches");
+		for (size_t p = 0; p < specs.size(); p++)
+			fprintf(out, ",%s_mispred,%s_mpki", specs[p], specs[p]);
+		fprintf(out, "\n");
+	}
+
+	for (size_t w = 0; w < start.size(); w++) {
+		fprintf(out, "%s,%llu,%llu,%llu", traceName, start[w], length[w], condBranch[w]);
+		for (UINT32 p = 0; p < numPreds; p++)
+			fprintf(out, ",%llu,%.4f", mispred[w * numPreds + p], MPKI(w, p));
+		fprintf(out, "\n");
+	}
+}
+
+static void JsonString(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', out);
+		fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+static void JsonArray(FILE *out, const std::vector<UINT64> &v, size_t first, size_t stride)
+{
+	fprintf(out, "[");
+	for (size_t i = first; i < v.size(); i += stride)
+		fprintf(out, "%s%llu", i == first ? "" : ",", v[i]);
+	fprintf(out, "]");
+}
+
+void INTERVAL_SERIES::WriteJson(FILE *out, const char *traceName,
+				const std::vector<const char *> &specs) const
+{
+	fprintf(out, "{\"trace\": ");
+	JsonString(out, traceName);
+	fprintf(out, ",\n   \"start\": ");
+	JsonArray(out, start, 0, 1);
+	fprintf(out, ",\n   \"instructions\": ");
+	JsonArray(out, length, 0, 1);
+	fprintf(out, ",\n   \"cond_branches\": ");
+	JsonArray(out, condBranch, 0, 1);
+	fprintf(out, ",\n   \"mispredictions\": {");
+	for (UINT32 p = 0; p < numPreds; p++) {
+		fprintf(out, "%s\n     ", p ? "," : "");
+		JsonString(out, specs[p]);
+		fprintf(out, ": ");
+		JsonArray(out, mispred, p, numPreds);
+	}
+	fprintf(out, "}}");
+}
+
+/////////////////////////////////////////////////////////////
+// representative windows
+/////////////////////////////////////////////////////////////
+
+void INTERVAL_SERIES::PrintRepresentatives(FILE *out, UINT32 k,
+					   const std::vector<const char *> &specs) const
+{
+	size_t numWindows = start.size();
+	UINT32 dims = numPreds + 1;	// MPKI per predictor, branches per 1K inst
+	UINT64 total = 0;
+
+	if (numWindows == 0)
+		return;
+	if (k > numWindows)
+		k = numWindows;
+
+	// features, each scaled to unit standard deviation over the windows
+	std::vector<double> f(numWindows * dims);
+	for (size_t w = 0; w < numWindows; w++) {
+		for (UINT32 p = 0; p < numPreds; p++)
+			f[w * dims + p] = MPKI(w, p);
+		f[w * dims + numPreds] = 1000.0 * condBranch[w] / length[w];
+		total += length[w];
+	}
+	for (UINT32 d = 0; d < dims; d++) {
+		double sum = 0, sumSq = 0;
+		for (size_t w = 0; w < numWindows; w++) {
+			sum += f[w * dims + d];
+			sumSq += f[w * dims + d] * f[w * dims + d];
+		}
+		double mean = sum / numWindows;
+		double sd = sqrt(fmax(sumSq / numWindows - mean * mean, 0.0));
+		for (size_t w = 0; w < numWindows; w++)
+			f[w * dims + d] = sd > 0 ? (f[w * dims + d] - mean) / sd : 0.0;
+	}
+
+	// squared distance from window w to centre c
+	std::vector<double> centre(k * dims);
+	auto dist = [&](size_t w, UINT32 c) {
+		double s = 0;
+		for (UINT32 d = 0; d < dims; d++) {
+			double x = f[w * dims + d] - centre[c * dims + d];
+			s += x * x;
+		}
+		return s;
+	};
+
+	// deterministic seeding: the first window, then repeatedly the window
+	// farthest from every centre chosen so far
+	std::vector<UINT32> cluster(numWindows, 0);
+	std::vector<double> nearest(numWindows, HUGE_VAL);
+	size_t seed = 0;
+	for (UINT32 c = 0; c < k; c++) {
+		for (UINT32 d = 0; d < dims; d++)
+			centre[c * dims + d] = f[seed * dims + d];
+		for (size_t w = 0; w < numWindows; w++) {
+			double x = dist(w, c);
+			if (x < nearest[w]) {
+				nearest[w] = x;
+				cluster[w] = c;
+			}
+		}
+		for (size_t w = 0; w < numWindows; w++)
+			if (nearest[w] > nearest[seed])
+				seed = w;
+	}
+
+	// Lloyd iterations, centres weighted by window length
+	for (int round = 0; round < INTERVAL_KMEANS_ROUNDS; round++) {
+		std::vector<double> weight(k, 0);
+		centre.assign(k * dims, 0);
+		for (size_t w = 0; w < numWindows; w++) {
+			weight[cluster[w]] += length[w];
+			for (UINT32 d = 0; d < dims; d++)
+				centre[cluster[w] * dims + d] += length[w] * f[w * dims + d];
+		}
+		for (UINT32 c = 0; c < k; c++)
+			for (UINT32 d = 0; weight[c] > 0 && d < dims; d++)
+				centre[c * dims + d] /= weight[c];
+
+		bool moved = false;
+		for (size_t w = 0; w < numWindows; w++) {
+			UINT32 best = cluster[w];
+			for (UINT32 c = 0; c < k; c++)
+				if (weight[c] > 0 && dist(w, c) < dist(w, best))
+					best = c;
+			moved |= (best != cluster[w]);
+			cluster[w] = best;
+		}
+		if (!moved)
+			break;
+	}
+
+	// the member nearest each centre stands for the whole cluster
+	std::vector<size_t> rep(k, numWindows);
+	std::vector<UINT64> covered(k, 0);
+	std::vector<UINT32> members(k, 0);
+	for (size_t w = 0; w < numWindows; w++) {
+		UINT32 c = cluster[w];
+		covered[c] += length[w];
+		members[c]++;
+		if (rep[c] == numWindows || dist(w, c) < dist(rep[c], c))
+			rep[c] = w;
+	}
+
+	fprintf(out, "\nREPRESENTATIVE_INTERVALS: %u clusters of %u windows\n", k, (UINT32) numWindows);
+	std::vector<double> estimate(numPreds, 0);
+	for (UINT32 c = 0; c < k; c++) {
+		if (members[c] == 0)
+			continue;
+		size_t w = rep[c];
+		double weight = (double) covered[c] / total;
+		fprintf(out, "  --roi %llu:%llu   weight %.4f  (%u windows)\n",
+			start[w], length[w], weight, members[c]);
+		for (UINT32 p = 0; p < numPreds; p++)
+			estimate[p] += weight * MPKI(w, p);
+	}
+
+	for (UINT32 p = 0; p < numPreds; p++) {
+		std::string label = std::string(specs[p]) + ":";
+		UINT64 sum = 0;
+		for (size_t w = 0; w < numWindows; w++)
+			sum += mispred[w * numPreds + p];
+		fprintf(out, "%-8s ESTIMATED_MISPRED_PER_1K_INST \t : %10.3f (full run %.3f)\n",
+			label.c_str(), estimate[p], 1000.0 * sum / total);
+	}
+}
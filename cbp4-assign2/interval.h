@@ -0,0 +1,60 @@
+#ifndef _INTERVAL_H_
+#define _INTERVAL_H_
+
+#include "utils.h"
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+// interval MPKI time series
+/////////////////////////////////////////////////////////////
+
+// INTERVAL_SERIES keeps, for each window of a run (see
+// CBP_TRACER::SetInterval), the instructions and conditional branches it
+// covered and each predictor's mispredictions in it. Windows are
+// numbered from the start of the run; base is the trace instruction the
+// run started at, so reported positions are trace positions.
+
+class INTERVAL_SERIES{
+ private:
+  UINT32 numPreds;
+  UINT64 base;
+  std::vector<UINT64> start;
+  std::vector<UINT64> length;
+  std::vector<UINT64> condBranch;
+  std::vector<UINT64> mispred;     // [window * numPreds + predictor]
+
+  UINT64 lastEnd;
+  UINT64 lastCondBranch;
+  std::vector<UINT64> lastMispred;
+
+  double MPKI(size_t w, UINT32 p) const {
+    return 1000.0 * mispred[w * numPreds + p] / length[w];
+  }
+
+ public:
+  INTERVAL_SERIES(UINT32 numPredictors, UINT64 baseInst);
+
+  // closes the window ending at run instruction end, given the running
+  // totals of conditional branches and of each predictor's mispredictions
+  void   Sample(UINT64 end, UINT64 numCondBranch, const std::vector<UINT64> &numMispred);
+
+  size_t NumWindows() const { return start.size(); }
+
+  // one row per window: trace,start,instructions,cond_branches and, per
+  // predictor spec, <spec>_mispred,<spec>_mpki
+  void   WriteCsv(FILE *out, const char *traceName, bool header,
+		  const std::vector<const char *> &specs) const;
+
+  // one JSON object with the series as columns
+  void   WriteJson(FILE *out, const char *traceName,
+		   const std::vector<const char *> &specs) const;
+
+  // Clusters the windows by their per-predictor MPKI and branch density
+  // (k-means) and prints the window nearest each cluster's centre as a
+  // --roi, weighted by the instructions its cluster covers, with the MPKI
+  // those regions predict for the whole run.
+  void   PrintRepresentatives(FILE *out, UINT32 k,
+			      const std::vector<const char *> &specs) const;
+};
+
+#endif
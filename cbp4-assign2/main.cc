@@ -17,95 +17,837 @@
 #include "utils.h"
 #include "tracer.h"
 #include "predictor.h"
+#include "target.h"
+#include "profile.h"
+#include "interval.h"
 
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 
-// usage: predictor <trace>
 
-int main(int argc, char* argv[]){
-  
-  if (argc != 2) {
-    printf("usage: %s <trace>\n", argv[0]);
-    exit(-1);
+// evaluated when no --pred is given
+static const char *defaultSpecs[] = { "2bitsat", "2level", "openend" };
+
+#define CBP_CHECKPOINT_MAGIC "CBPCKPT"
+
+// window of the interval series when only its outputs are asked for
+#define CBP_DEFAULT_INTERVAL  1000000
+
+
+/////////////////////////////////////////////////////////////
+// command-line configuration shared by every run
+/////////////////////////////////////////////////////////////
+
+class CBP_CONFIG{
+  public:
+  std::vector<const char *> specs;
+  std::vector<const char *> targetSpecs;
+  bool                      batchMode;
+  const char               *loadCheckpoint;   // NULL: predictors start cold
+  const char               *saveCheckpoint;   // NULL: nothing is saved
+  UINT32                    profileTop;       // hard branches reported per predictor
+  const char               *profileCsv;       // NULL: no per-branch CSV
+  bool                      profile;          // keep a per-branch profile
+  UINT64                    interval;         // instructions per window, 0: no series
+  const char               *intervalCsv;      // NULL: no time series CSV
+  const char               *intervalJson;     // NULL: no time series JSON
+  UINT32                    pickIntervals;    // representative windows per run
+  bool                      sweep;            // --sweep: direction predictors only,
+  int                       sweepThreads;     //   split across this many threads
+
+  CBP_CONFIG(){
+    batchMode=false;
+    loadCheckpoint=NULL;
+    saveCheckpoint=NULL;
+    profileTop=0;
+    profileCsv=NULL;
+    profile=false;
+    interval=0;
+    intervalCsv=NULL;
+    intervalJson=NULL;
+    pickIntervals=0;
+    sweep=false;
+    sweepThreads=1;
   }
-  
+};
+
+
+/////////////////////////////////////////////////////////////
+// one trace and the predictors simulated over it
+/////////////////////////////////////////////////////////////
+
+class CBP_RUN{
+  public:
+  char                     *traceName;
+  UINT64                    start;     // first instruction simulated
+  UINT64                    length;    // instructions to simulate, 0 = to the end
+  CBP_TRACER               *tracer;
+
+  std::vector<PREDICTOR *>  preds;
+  std::vector<UINT64>       numMispred;
+
+  std::vector<TARGET_PREDICTOR *> targets;
+  std::vector<UINT64>       numTargetMispred;   // [target * TCLASS_MAX + class]
+  std::vector<UINT64>       numTargetBranch;    // [class]
+
+  BRANCH_PROFILE           *profile;   // NULL unless profiling
+  INTERVAL_SERIES          *series;    // NULL without --interval
+
+  CBP_RUN(char *name, UINT64 roiStart, UINT64 roiLength){
+    traceName=name;
+    start=roiStart;
+    length=roiLength;
+    tracer=NULL;
+    profile=NULL;
+    series=NULL;
+  }
+
+  // the trace name, with the region when there is one
+  std::string Name() const {
+    char roi[64] = "";
+    if (start > 0 || length > 0) {
+      snprintf(roi, sizeof(roi), "@%llu:%llu", start, length);
+    }
+    return std::string(traceName) + roi;
+  }
+};
+
+
+/////////////////////////////////////////////////////////////
+// batch driver: one predictor over every branch of a batch; with a
+// profile, slot[i] is the profile slot of the i-th conditional branch
+/////////////////////////////////////////////////////////////
+
+static UINT64 RunBatch(CBP_TRACE_BATCH *batch, PREDICTOR *pred,
+		       BRANCH_PROFILE *profile, const UINT32 *slot, UINT32 predIdx){
+  UINT64 numMispred=0;
+
+  for(UINT32 i=0; i < batch->numCond; i++){
+    UINT32 idx = batch->condIdx[i];
+    bool   resolveDir = batch->branchTaken[idx];
+    bool   predDir = pred->GetPrediction(batch->PC[idx]);
+
+    pred->UpdatePredictor(batch->PC[idx], resolveDir, predDir, batch->branchTarget[idx]);
+    numMispred += (predDir != resolveDir);
+    if (profile && predDir != resolveDir) {
+      profile->Mispredict(slot[i], predIdx);
+    }
+  }
+
+  return numMispred;
+}
+
+
+/////////////////////////////////////////////////////////////
+// sweep driver: the predictors are split across threads, and every
+// thread runs its share over each batch the calling thread decodes.
+// Batches go through a ring, so decoding runs ahead of the slowest
+// thread by up to CBP_SWEEP_RING batches.
+/////////////////////////////////////////////////////////////
+
+#define CBP_SWEEP_RING 8
+
+static void RunSweep(CBP_TRACER *tracer, std::vector<PREDICTOR *> &preds,
+		     std::vector<UINT64> &numMispred, int numThreads){
+  CBP_TRACE_BATCH *ring = new CBP_TRACE_BATCH[CBP_SWEEP_RING];
+  std::atomic<UINT64> decoded(0);
+  std::atomic<bool> finished(false);
+  std::atomic<UINT64> *done = new std::atomic<UINT64>[numThreads];
+  std::vector<std::thread> workers;
+
+  for (int w = 0; w < numThreads; w++) {
+    done[w].store(0);
+    workers.push_back(std::thread([&, w]() {
+      for (UINT64 s = 0; ; s++) {
+	while (decoded.load(std::memory_order_acquire) <= s) {
+	  if (finished.load(std::memory_order_acquire) &&
+	      decoded.load(std::memory_order_acquire) <= s) {
+	    return;
+	  }
+	  std::this_thread::yield();
+	}
+	for (size_t p = w; p < preds.size(); p += numThreads) {
+	  numMispred[p] += RunBatch(&ring[s % CBP_SWEEP_RING], preds[p], NULL, NULL, 0);
+	}
+	done[w].store(s + 1, std::memory_order_release);
+      }
+    }));
+  }
+
+  for (UINT64 s = 0; ; s++) {
+    // the slot is free once every thread is done with its last batch
+    for (int w = 0; w < numThreads; w++) {
+      while (done[w].load(std::memory_order_acquire) + CBP_SWEEP_RING <= s) {
+	std::this_thread::yield();
+      }
+    }
+    if (!tracer->GetNextBatch(&ring[s % CBP_SWEEP_RING], CBP_BATCH_SIZE)) {
+      break;
+    }
+    decoded.store(s + 1, std::memory_order_release);
+  }
+  finished.store(true, std::memory_order_release);
+
+  for (int w = 0; w < numThreads; w++) {
+    workers[w].join();
+  }
+  delete [] done;
+  delete [] ring;
+}
+
+
+/////////////////////////////////////////////////////////////
+// target prediction of one control transfer, every target predictor
+/////////////////////////////////////////////////////////////
+
+static void RunTargets(std::vector<TARGET_PREDICTOR *> &targets, UINT32 PC, UINT32 opType,
+		       bool taken, UINT32 branchTarget, std::vector<UINT64> &numTargetBranch,
+		       std::vector<UINT64> &numTargetMispred){
+  int tclass = GetTargetClass(opType);
+
+  if (tclass != TCLASS_MAX) {
+    numTargetBranch[tclass]++;
+  }
+
+  for (size_t t = 0; t < targets.size(); t++) {
+    if (tclass != TCLASS_MAX && targets[t]->PredictTarget(PC, opType) != branchTarget) {
+      numTargetMispred[t * TCLASS_MAX + tclass]++;
+    }
+    targets[t]->UpdateTarget(PC, opType, taken, branchTarget);
+  }
+}
+
+
+/////////////////////////////////////////////////////////////
+// checkpoints: magic, instruction count, the predictor and target
+// specs, then the state of each predictor and target in that order
+/////////////////////////////////////////////////////////////
+
+static bool CheckpointHeader(CHECKPOINT &cp, UINT64 &inst, std::vector<std::string> &specs,
+			     std::vector<std::string> &targetSpecs){
+  char   magic[8];
+  UINT32 n;
+
+  memcpy(magic, CBP_CHECKPOINT_MAGIC, 8);
+  cp.IO(magic, 8);
+  if (memcmp(magic, CBP_CHECKPOINT_MAGIC, 8) != 0) {
+    cp.Fail();
+  }
+  cp.Value(inst);
+
+  n = specs.size();
+  cp.Value(n);
+  if (!cp.Ok()) return false;
+  specs.resize(n);
+  for (UINT32 i = 0; i < n; i++) {
+    cp.String(specs[i]);
+  }
+
+  n = targetSpecs.size();
+  cp.Value(n);
+  if (!cp.Ok()) return false;
+  targetSpecs.resize(n);
+  for (UINT32 i = 0; i < n; i++) {
+    cp.String(targetSpecs[i]);
+  }
+
+  return cp.Ok();
+}
+
+static bool CheckpointFile(const char *fileName, bool save, UINT64 &inst,
+			   const CBP_CONFIG &cfg, std::vector<PREDICTOR *> &preds,
+			   std::vector<TARGET_PREDICTOR *> &targets){
+  FILE *fp = fopen(fileName, save ? "wb" : "rb");
+  CHECKPOINT cp(fp, save);
+  std::vector<std::string> specs(cfg.specs.begin(), cfg.specs.end());
+  std::vector<std::string> targetSpecs(cfg.targetSpecs.begin(), cfg.targetSpecs.end());
+
+  if (CheckpointHeader(cp, inst, specs, targetSpecs) &&
+      specs.size() == preds.size() && targetSpecs.size() == targets.size()) {
+    for (size_t p = 0; p < preds.size(); p++) {
+      preds[p]->Checkpoint(cp);
+    }
+    for (size_t t = 0; t < targets.size(); t++) {
+      targets[t]->Checkpoint(cp);
+    }
+  } else {
+    cp.Fail();
+  }
+
+  if (fp != NULL && fclose(fp) != 0) {
+    cp.Fail();
+  }
+  return cp.Ok();
+}
+
+
+/////////////////////////////////////////////////////////////
+// simulate one trace (or one region of it), all predictors in one pass
+/////////////////////////////////////////////////////////////
+
+static void SimulateTrace(CBP_RUN *run, const CBP_CONFIG &cfg, bool heartBeat){
+
+    const std::vector<const char *> &specs = cfg.specs;
+    const std::vector<const char *> &targetSpecs = cfg.targetSpecs;
+    bool batchMode = cfg.batchMode;
+
   ///////////////////////////////////////////////
   // Init variables
   ///////////////////////////////////////////////
     
-    CBP_TRACER *tracer = new CBP_TRACER(argv[1]);
+    CBP_TRACER *tracer = new CBP_TRACER(run->traceName);
     CBP_TRACE_RECORD *trace = new CBP_TRACE_RECORD();
+    size_t numPreds = specs.size();
+
+    tracer->SetHeartBeat(heartBeat);
+    tracer->SetBranchOnly(true);   // only control transfers are simulated
+
+    if (run->start > 0 && !tracer->Seek(run->start)) {
+      printf("Trace %s has fewer than %llu instructions. Dying\n", run->traceName, run->start);
+      exit(-1);
+    }
+    if (run->length > 0) {
+      tracer->SetLimit(run->length);
+    }
+
+    std::vector<PREDICTOR *> preds(numPreds);
+    std::vector<UINT64>      numMispred(numPreds, 0);
+    std::vector<bool>        predDir(numPreds);
+    BRANCH_PROFILE          *profile = cfg.profile ? new BRANCH_PROFILE(numPreds) : NULL;
+    INTERVAL_SERIES         *series = cfg.interval ? new INTERVAL_SERIES(numPreds, run->start) : NULL;
+
+    for (size_t p = 0; p < numPreds; p++) {
+      preds[p] = CreatePredictor(specs[p]);
+    }
+
+    size_t numTargets = targetSpecs.size();
+    std::vector<TARGET_PREDICTOR *> targets(numTargets);
+    std::vector<UINT64> numTargetMispred(numTargets * TCLASS_MAX, 0);
+    std::vector<UINT64> numTargetBranch(TCLASS_MAX, 0);
+
+    for (size_t t = 0; t < numTargets; t++) {
+      targets[t] = CreateTargetPredictor(targetSpecs[t]);
+    }
 
-    UINT64     numMispred_2bitsat =0;  
-    UINT64     numMispred_2level =0;  
-    UINT64     numMispred_openend =0;  
+    if (cfg.loadCheckpoint) {
+      UINT64 inst;
+      if (!CheckpointFile(cfg.loadCheckpoint, false, inst, cfg, preds, targets)) {
+	printf("Unable to restore checkpoint %s. Dying\n", cfg.loadCheckpoint);
+	exit(-1);
+      }
+    }
 
-    InitPredictor_2bitsat();
-    InitPredictor_2level();
-    InitPredictor_openend();
+    // the tracer closes each window once numMispred covers all of it
+    if (series) {
+      tracer->SetInterval(cfg.interval, [&](UINT64 end) {
+	series->Sample(end, tracer->GetNumCondBranch(), numMispred);
+      });
+    }
     
   ///////////////////////////////////////////////
-  // read each trace recod, simulate until done
+  // batch mode: each predictor sweeps a whole batch
+  // before the next one is decoded
   ///////////////////////////////////////////////
 
-      while (tracer->GetNextRecord(trace)) {
+    if (cfg.sweep) {
+      RunSweep(tracer, preds, numMispred, cfg.sweepThreads);
+    }
+    else if (batchMode) {
+      CBP_TRACE_BATCH *batch = new CBP_TRACE_BATCH();
+      std::vector<UINT32> slot(profile ? CBP_BATCH_SIZE : 0);
 
-	if(trace->opType == OPTYPE_BRANCH_COND){
-      bool predDir_2bitsat;
-      bool predDir_2level;
-      bool predDir_openend;
+      while (tracer->GetNextBatch(batch, CBP_BATCH_SIZE)) {
+	// the slots are kept for the whole batch, so none may move
+	if (profile) {
+	  profile->Reserve(batch->numCond);
+	}
+	for (UINT32 i = 0; profile && i < batch->numCond; i++) {
+	  UINT32 idx = batch->condIdx[i];
+	  slot[i] = profile->Record(batch->PC[idx], batch->branchTaken[idx]);
+	}
 
-      // 2bitsat
-	  predDir_2bitsat = GetPrediction_2bitsat(trace->PC);
+	for (size_t p = 0; p < numPreds; p++) {
+	  numMispred[p] += RunBatch(batch, preds[p], profile, slot.data(), p);
+	}
 
-      // 2level
-	  predDir_2level = GetPrediction_2level(trace->PC);
+	for (UINT32 i = 0; numTargets && i < batch->numBranch; i++) {
+	  UINT32 idx = batch->branchIdx[i];
+	  RunTargets(targets, batch->PC[idx], batch->opType[idx], batch->branchTaken[idx],
+		     batch->branchTarget[idx], numTargetBranch, numTargetMispred);
+	}
+      }
 
-      // openend
-	  predDir_openend = GetPrediction_openend(trace->PC);
+      delete batch;
+    }
 
-      // 2bitsat
-	  UpdatePredictor_2bitsat(trace->PC, trace->branchTaken, 
-				  predDir_2bitsat, trace->branchTarget);
-	  
-	  if(predDir_2bitsat != trace->branchTaken){
-	    numMispred_2bitsat++; // update mispred stats
-	  }
-	  
-      // 2level
-	  UpdatePredictor_2level(trace->PC, trace->branchTaken, 
-				  predDir_2level, trace->branchTarget);
-	  
-	  if(predDir_2level != trace->branchTaken){
-	    numMispred_2level++; // update mispred stats
+  ///////////////////////////////////////////////
+  // read each trace recod, simulate until done
+  ///////////////////////////////////////////////
+
+      while (!batchMode && !cfg.sweep && tracer->GetNextRecord(trace)) {
+
+	if(trace->opType == OPTYPE_BRANCH_COND){
+
+	  UINT32 slot = profile ? profile->Record(trace->PC, trace->branchTaken) : 0;
+
+	  for (size_t p = 0; p < numPreds; p++) {
+	    predDir[p] = preds[p]->GetPrediction(trace->PC);
 	  }
+
+	  for (size_t p = 0; p < numPreds; p++) {
+	    preds[p]->UpdatePredictor(trace->PC, trace->branchTaken, 
+				      predDir[p], trace->branchTarget);
 	  
-      // openend
-	  UpdatePredictor_openend(trace->PC, trace->branchTaken, 
-				  predDir_openend, trace->branchTarget);
-	  
-	  if(predDir_openend != trace->branchTaken){
-	    numMispred_openend++; // update mispred stats
+	    if(predDir[p] != trace->branchTaken){
+	      numMispred[p]++; // update mispred stats
+	      if (profile) profile->Mispredict(slot, p);
+	    }
 	  }
 	  
 	}
+
+	if(numTargets && trace->opType >= OPTYPE_CALL_DIRECT){
+	  RunTargets(targets, trace->PC, trace->opType, trace->branchTaken,
+		     trace->branchTarget, numTargetBranch, numTargetMispred);
+	}
       
       }
 
+    delete trace;
+
+    if (cfg.saveCheckpoint) {
+      UINT64 inst = run->start + tracer->GetNumInst();
+      if (!CheckpointFile(cfg.saveCheckpoint, true, inst, cfg, preds, targets)) {
+	printf("Unable to write checkpoint %s. Dying\n", cfg.saveCheckpoint);
+	exit(-1);
+      }
+    }
+
+    run->tracer = tracer;
+    run->preds = preds;
+    run->numMispred = numMispred;
+    run->targets = targets;
+    run->numTargetMispred = numTargetMispred;
+    run->numTargetBranch = numTargetBranch;
+    run->profile = profile;
+    run->series = series;
+}
+
+
+/////////////////////////////////////////////////////////////
+// print_stats
+/////////////////////////////////////////////////////////////
+
+static void PrintStats(UINT64 numInst, UINT64 numCondBranch,
+		       const std::vector<const char *> &specs,
+		       const std::vector<UINT64> &numMispred,
+		       const std::vector<const char *> &targetSpecs,
+		       const std::vector<UINT64> &numTargetBranch,
+		       const std::vector<UINT64> &numTargetMispred){
+      printf("\n");
+      printf("\nNUM_INSTRUCTIONS     \t : %10llu",   numInst);
+      printf("\nNUM_CONDITIONAL_BR   \t : %10llu",   numCondBranch);
+      printf("\n");
+      for (size_t p = 0; p < specs.size(); p++) {
+	std::string label = std::string(specs[p]) + ":";
+	printf("\n%-8s NUM_MISPREDICTIONS   \t : %10llu",   label.c_str(), numMispred[p]);
+	printf("\n%-8s MISPRED_PER_1K_INST  \t : %10.3f",   label.c_str(), 1000.0*(double)(numMispred[p])/(double)(numInst));
+      }
+      if (!targetSpecs.empty()) {
+	printf("\n");
+	for (int c = 0; c < TCLASS_MAX; c++) {
+	  printf("\nNUM_%-17s\t : %10llu",   targetClassName[c], numTargetBranch[c]);
+	}
+	printf("\n");
+      }
+      for (size_t t = 0; t < targetSpecs.size(); t++) {
+	std::string label = std::string(targetSpecs[t]) + ":";
+	for (int c = 0; c < TCLASS_MAX; c++) {
+	  UINT64 n = numTargetMispred[t * TCLASS_MAX + c];
+	  printf("\n%-8s %-16s TARGET_MISPREDICTIONS      \t : %10llu",   label.c_str(), targetClassName[c], n);
+	  printf("\n%-8s %-16s TARGET_MISPRED_PER_1K_INST \t : %10.3f",   label.c_str(), targetClassName[c], 1000.0*(double)n/(double)(numInst));
+	}
+      }
+      printf("\n\n");
+}
+
+
+/////////////////////////////////////////////////////////////
+// sweep table: every configuration by storage, those that beat every
+// smaller one marked with '*'
+/////////////////////////////////////////////////////////////
+
+static bool ByStorage(const std::pair<UINT64, double> &a, const std::pair<UINT64, double> &b){
+  return (a.first != b.first) ? a.first < b.first : a.second < b.second;
+}
+
+static void PrintSweep(UINT64 numInst, UINT64 numCondBranch,
+		       const std::vector<const char *> &specs,
+		       const std::vector<UINT64> &numMispred,
+		       const std::vector<UINT64> &storageBits){
+  std::vector< std::pair<UINT64, double> > key(specs.size());
+  std::vector<size_t> order(specs.size());
+
+  for (size_t p = 0; p < specs.size(); p++) {
+    key[p] = std::make_pair(storageBits[p], (double) numMispred[p]);
+    order[p] = p;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return ByStorage(key[a], key[b]); });
+
+  printf("\n");
+  printf("\nNUM_INSTRUCTIONS     \t : %10llu",   numInst);
+  printf("\nNUM_CONDITIONAL_BR   \t : %10llu",   numCondBranch);
+  printf("\n\n  %-28s %14s %10s %12s %10s\n", "SPEC", "STORAGE_BITS", "KB", "MISPRED", "MPKI");
+
+  UINT64 best = ~0ULL;
+  for (size_t i = 0; i < order.size(); i++) {
+    size_t p = order[i];
+    bool   front = numMispred[p] < best;
+    if (front) best = numMispred[p];
+    printf("%c %-28s %14llu %10.2f %12llu %10.3f\n", front ? '*' : ' ', specs[p],
+	   storageBits[p], storageBits[p] / 8192.0, numMispred[p],
+	   1000.0*(double)(numMispred[p])/(double)(numInst));
+  }
+  printf("\n");
+}
+
+
+static void Usage(char *prog){
+  printf("usage: %s [--batch] [--threads N] [--pred <spec>]... [--target <spec>]...\n"
+	 "       [--roi <start>:<length>]... [--load-checkpoint <file>]\n"
+	 "       [--warmup <instructions> --save-checkpoint <file>]\n"
+	 "       [--profile <N>] [--profile-csv <file>]\n"
+	 "       [--interval <instructions>] [--interval-csv <file>]\n"
+	 "       [--interval-json <file>] [--pick-intervals <K>]\n"
+	 "       [--sweep <grid spec>]...\n"
+	 "       <trace> [<trace> ...]\n"
+	 "   or: %s --build-index <trace> [<trace> ...]\n", prog, prog);
+  printf("predictor specs (default: 2bitsat 2level openend):\n");
+  PrintPredictorUsage(stdout);
+  printf("a grid spec gives each argument as a value, lo-hi or a list, e.g.\n"
+	 "  --sweep gshare:10-20 --sweep 2level:6-12:4,8:1,8\n");
+  printf("target predictor specs (default: none):\n");
+  PrintTargetPredictorUsage(stdout);
+  exit(-1);
+}
+
+
+int main(int argc, char* argv[]){
+  
+  CBP_CONFIG cfg;
+  int   numThreads = std::thread::hardware_concurrency();
+  bool  buildIndex = false;
+  UINT64 warmup = 0;
+  std::vector<char *> traceNames;
+  std::vector<UINT64> roiStart, roiLength;
+  std::vector<std::string> ckptSpecs, ckptTargetSpecs, sweepSpecs;
+  std::vector<CBP_RUN *> runs;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--batch") == 0) {
+      cfg.batchMode = true;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      numThreads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--pred") == 0 && i + 1 < argc) {
+      cfg.specs.push_back(argv[++i]);
+    } else if (strcmp(argv[i], "--target") == 0 && i + 1 < argc) {
+      cfg.targetSpecs.push_back(argv[++i]);
+    } else if (strcmp(argv[i], "--roi") == 0 && i + 1 < argc) {
+      char *end;
+      roiStart.push_back(strtoull(argv[++i], &end, 0));
+      if (*end != ':') Usage(argv[0]);
+      roiLength.push_back(strtoull(end + 1, &end, 0));
+      if (*end != '\0') Usage(argv[0]);
+    } else if (strcmp(argv[i], "--load-checkpoint") == 0 && i + 1 < argc) {
+      cfg.loadCheckpoint = argv[++i];
+    } else if (strcmp(argv[i], "--save-checkpoint") == 0 && i + 1 < argc) {
+      cfg.saveCheckpoint = argv[++i];
+    } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      warmup = strtoull(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      cfg.profileTop = atoi(argv[++i]);
+      cfg.profile = true;
+    } else if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc) {
+      cfg.profileCsv = argv[++i];
+      cfg.profile = true;
+    } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+      cfg.interval = strtoull(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "--interval-csv") == 0 && i + 1 < argc) {
+      cfg.intervalCsv = argv[++i];
+    } else if (strcmp(argv[i], "--interval-json") == 0 && i + 1 < argc) {
+      cfg.intervalJson = argv[++i];
+    } else if (strcmp(argv[i], "--pick-intervals") == 0 && i + 1 < argc) {
+      cfg.pickIntervals = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+      if (!ExpandSpecGrid(argv[++i], sweepSpecs)) {
+	printf("Bad grid spec '%s'.\n", argv[i]);
+	Usage(argv[0]);
+      }
+      cfg.sweep = true;
+    } else if (strcmp(argv[i], "--build-index") == 0) {
+      buildIndex = true;
+    } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+      Usage(argv[0]);
+    } else {
+      traceNames.push_back(argv[i]);
+    }
+  }
+
+  if (traceNames.empty()) {
+    Usage(argv[0]);
+  }
+
+  if ((cfg.intervalCsv || cfg.intervalJson || cfg.pickIntervals) && cfg.interval == 0) {
+    cfg.interval = CBP_DEFAULT_INTERVAL;
+  }
+
+  // a sweep only counts direction mispredictions, and keeps one run at a
+  // time in flight with its predictors spread over the threads
+  if (cfg.sweep) {
+    if (!cfg.targetSpecs.empty() || cfg.profile || cfg.interval ||
+	cfg.loadCheckpoint || cfg.saveCheckpoint) {
+      printf("--sweep cannot be combined with --target, --profile, --interval or checkpoints.\n");
+      Usage(argv[0]);
+    }
+    for (size_t s = 0; s < sweepSpecs.size(); s++) {
+      cfg.specs.push_back(sweepSpecs[s].c_str());
+    }
+    cfg.sweepThreads = numThreads < 1 ? 1 : numThreads;
+    numThreads = 1;
+  }
+
+  ///////////////////////////////////////////////
+  // restart-point indices for gzip traces
+  ///////////////////////////////////////////////
+
+  if (buildIndex) {
+    for (size_t r = 0; r < traceNames.size(); r++) {
+      int numPoints = CBP_TRACER::BuildIndex(traceNames[r], CBP_INDEX_SPAN);
+      if (numPoints < 0) {
+	printf("%s: unable to index the trace\n", traceNames[r]);
+	exit(-1);
+      }
+      printf("%s: %d restart points\n", traceNames[r], numPoints);
+    }
+    exit(0);
+  }
+
+  ///////////////////////////////////////////////
+  // a checkpoint fixes the predictors and where
+  // the simulation resumes
+  ///////////////////////////////////////////////
+
+  UINT64 resumeInst = 0;
+
+  if (cfg.loadCheckpoint) {
+    FILE *fp = fopen(cfg.loadCheckpoint, "rb");
+    CHECKPOINT cp(fp, false);
+
+    if (!CheckpointHeader(cp, resumeInst, ckptSpecs, ckptTargetSpecs)) {
+      printf("Unable to read checkpoint %s. Dying\n", cfg.loadCheckpoint);
+      exit(-1);
+    }
+    fclose(fp);
+    if (!cfg.specs.empty() || !cfg.targetSpecs.empty()) {
+      printf("--pred and --target cannot be combined with --load-checkpoint.\n");
+      Usage(argv[0]);
+    }
+    for (size_t p = 0; p < ckptSpecs.size(); p++) {
+      cfg.specs.push_back(ckptSpecs[p].c_str());
+    }
+    for (size_t t = 0; t < ckptTargetSpecs.size(); t++) {
+      cfg.targetSpecs.push_back(ckptTargetSpecs[t].c_str());
+    }
+  }
+
+  if (cfg.saveCheckpoint) {
+    if (warmup == 0 || traceNames.size() != 1 || !roiStart.empty()) {
+      printf("--save-checkpoint takes one trace and a --warmup length, and no --roi.\n");
+      Usage(argv[0]);
+    }
+    roiStart.push_back(resumeInst);
+    roiLength.push_back(warmup);
+  }
+
+  if (roiStart.empty()) {
+    roiStart.push_back(resumeInst);
+    roiLength.push_back(0);
+  }
+
+  for (size_t r = 0; r < traceNames.size(); r++) {
+    for (size_t i = 0; i < roiStart.size(); i++) {
+      runs.push_back(new CBP_RUN(traceNames[r], roiStart[i], roiLength[i]));
+    }
+  }
+
+  std::vector<const char *> &specs = cfg.specs;
+  std::vector<const char *> &targetSpecs = cfg.targetSpecs;
+
+  if (specs.empty()) {
+    specs.assign(defaultSpecs, defaultSpecs + sizeof(defaultSpecs) / sizeof(defaultSpecs[0]));
+  }
+
+  // reject bad specs before any trace is opened
+  for (size_t p = 0; p < specs.size(); p++) {
+    PREDICTOR *probe = CreatePredictor(specs[p]);
+    if (probe == NULL) {
+      printf("Unknown predictor spec '%s'.\n", specs[p]);
+      Usage(argv[0]);
+    }
+    delete probe;
+  }
+  for (size_t t = 0; t < targetSpecs.size(); t++) {
+    TARGET_PREDICTOR *probe = CreateTargetPredictor(targetSpecs[t]);
+    if (probe == NULL) {
+      printf("Unknown target predictor spec '%s'.\n", targetSpecs[t]);
+      Usage(argv[0]);
+    }
+    delete probe;
+  }
+
+  if (numThreads < 1) {
+    numThreads = 1;
+  }
+  if (numThreads > (int) runs.size()) {
+    numThreads = runs.size();
+  }
+
+  ///////////////////////////////////////////////
+  // one trace (or region) per worker, each worker
+  // pulls the next unclaimed run until none are left
+  ///////////////////////////////////////////////
+
+    bool multiTrace = (runs.size() > 1);
+    std::atomic<size_t> nextRun(0);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < numThreads; t++) {
+      workers.push_back(std::thread([&]() {
+	size_t r;
+	while ((r = nextRun++) < runs.size()) {
+	  SimulateTrace(runs[r], cfg, !multiTrace);
+	}
+      }));
+    }
+
+    for (size_t t = 0; t < workers.size(); t++) {
+      workers[t].join();
+    }
+
     ///////////////////////////////////////////
     //print_stats
     ///////////////////////////////////////////
 
+    if (cfg.profileCsv) {
+      FILE *csv = fopen(cfg.profileCsv, "w");
+      if (csv == NULL) {
+	printf("Unable to open %s. Dying\n", cfg.profileCsv);
+	exit(-1);
+      }
+      for (size_t r = 0; r < runs.size(); r++) {
+	runs[r]->profile->WriteCsv(csv, runs[r]->Name().c_str(), r == 0, specs);
+      }
+      fclose(csv);
+    }
+
+    if (cfg.intervalCsv) {
+      FILE *csv = fopen(cfg.intervalCsv, "w");
+      if (csv == NULL) {
+	printf("Unable to open %s. Dying\n", cfg.intervalCsv);
+	exit(-1);
+      }
+      for (size_t r = 0; r < runs.size(); r++) {
+	runs[r]->series->WriteCsv(csv, runs[r]->Name().c_str(), r == 0, specs);
+      }
+      fclose(csv);
+    }
+
+    if (cfg.intervalJson) {
+      FILE *json = fopen(cfg.intervalJson, "w");
+      if (json == NULL) {
+	printf("Unable to open %s. Dying\n", cfg.intervalJson);
+	exit(-1);
+      }
+      fprintf(json, "{\"interval\": %llu,\n \"runs\": [\n  ", cfg.interval);
+      for (size_t r = 0; r < runs.size(); r++) {
+	if (r > 0) fprintf(json, ",\n  ");
+	runs[r]->series->WriteJson(json, runs[r]->Name().c_str(), specs);
+      }
+      fprintf(json, "\n]}\n");
+      fclose(json);
+    }
+
+    UINT64 totInst = 0, totCondBranch = 0;
+    std::vector<UINT64> totMispred(specs.size(), 0);
+    std::vector<double> sumMPKI(specs.size(), 0);
+    std::vector<UINT64> totTargetBranch(TCLASS_MAX, 0);
+    std::vector<UINT64> totTargetMispred(targetSpecs.size() * TCLASS_MAX, 0);
+    std::vector<UINT64> storageBits(specs.size());
+
+    for (size_t p = 0; p < specs.size(); p++) {
+      storageBits[p] = runs[0]->preds[p]->StorageBits();
+    }
+
+    for (size_t r = 0; r < runs.size(); r++) {
+      CBP_RUN *run = runs[r];
+      UINT64   numInst = run->tracer->GetNumInst();
+
+      if (multiTrace) {
+	printf("\nTRACE: %s", run->traceName);
+	if (run->start > 0 || run->length > 0) {
+	  printf(" ROI: %llu:%llu", run->start, run->length);
+	}
+      }
+      if (cfg.sweep) {
+	PrintSweep(numInst, run->tracer->GetNumCondBranch(), specs, run->numMispred, storageBits);
+      } else {
+	PrintStats(numInst, run->tracer->GetNumCondBranch(), specs, run->numMispred,
+		   targetSpecs, run->numTargetBranch, run->numTargetMispred);
+      }
+
+      for (size_t p = 0; run->profile && cfg.profileTop && p < specs.size(); p++) {
+	std::string label = std::string(specs[p]) + ":";
+	run->profile->PrintTop(stdout, cfg.profileTop, p, label.c_str());
+      }
+      if (run->profile && cfg.profileTop) {
+	printf("\n");
+      }
+      if (run->series && cfg.pickIntervals) {
+	run->series->PrintRepresentatives(stdout, cfg.pickIntervals, specs);
+	printf("\n");
+      }
+
+      totInst += numInst;
+      totCondBranch += run->tracer->GetNumCondBranch();
+      for (size_t p = 0; p < specs.size(); p++) {
+	totMispred[p] += run->numMispred[p];
+	sumMPKI[p] += 1000.0*(double)(run->numMispred[p])/(double)(numInst);
+      }
+      for (size_t i = 0; i < totTargetMispred.size(); i++) {
+	totTargetMispred[i] += run->numTargetMispred[i];
+      }
+      for (int c = 0; c < TCLASS_MAX; c++) {
+	totTargetBranch[c] += run->numTargetBranch[c];
+      }
+    }
+
+    if (multiTrace) {
+      printf("\nAGGREGATE: %d traces", (int) runs.size());
+      if (cfg.sweep) {
+	PrintSweep(totInst, totCondBranch, specs, totMispred, storageBits);
+      } else {
+	PrintStats(totInst, totCondBranch, specs, totMispred,
+		   targetSpecs, totTargetBranch, totTargetMispred);
+      }
+      for (size_t p = 0; p < specs.size(); p++) {
+	std::string label = std::string(specs[p]) + ":";
+	printf("%-8s MEAN_MISPRED_PER_1K_INST \t : %10.3f\n", label.c_str(), sumMPKI[p] / (double) runs.size());
+      }
       printf("\n");
-      printf("\nNUM_INSTRUCTIONS     \t : %10llu",   tracer->GetNumInst());
-      printf("\nNUM_CONDITIONAL_BR   \t : %10llu",   tracer->GetNumCondBranch());
-      printf("\n");
-      printf("\n2bitsat: NUM_MISPREDICTIONS   \t : %10llu",   numMispred_2bitsat);
-      printf("\n2bitsat: MISPRED_PER_1K_INST  \t : %10.3f",   1000.0*(double)(numMispred_2bitsat)/(double)(tracer->GetNumInst()));
-      printf("\n2level:  NUM_MISPREDICTIONS   \t : %10llu",   numMispred_2level);
-      printf("\n2level:  MISPRED_PER_1K_INST  \t : %10.3f",   1000.0*(double)(numMispred_2level)/(double)(tracer->GetNumInst()));
-      printf("\nopenend: NUM_MISPREDICTIONS   \t : %10llu",   numMispred_openend);
-      printf("\nopenend: MISPRED_PER_1K_INST  \t : %10.3f",   1000.0*(double)(numMispred_openend)/(double)(tracer->GetNumInst()));
-      printf("\n\n");
+    }
 }
 
 
@@ -0,0 +1,194 @@
+#include "perceptron.h"
+#include <stdlib.h>
+#include <math.h>
+
+#if !defined(PERCEPTRON_SCALAR) && defined(__AVX2__)
+#define PERCEPTRON_AVX2
+#endif
+#if !defined(PERCEPTRON_SCALAR) && defined(__SSE2__)
+#define PERCEPTRON_SSE2
+#endif
+
+#if defined(PERCEPTRON_AVX2)
+#include <immintrin.h>
+#elif defined(PERCEPTRON_SSE2)
+#include <emmintrin.h>
+#endif
+
+/////////////////////////////////////////////////////////////
+// hashed perceptron
+/////////////////////////////////////////////////////////////
+
+PREDICTOR_PERCEPTRON::PREDICTOR_PERCEPTRON(UINT32 logRowsPerTable, UINT32 maxHistory)
+{
+	logRows = logRowsPerTable;
+	rowMask = (1 << logRows) - 1;
+
+	// table 0 is the bias, the others take geometric history lengths
+	// from 2 up to maxHistory
+	histLength[0] = 0;
+	for (int t = 1; t < PERCEPTRON_TABLES; t++) {
+		double ratio = pow((double) maxHistory / 2, (double) (t - 1) / (PERCEPTRON_TABLES - 2));
+		histLength[t] = (UINT32) (2 * ratio + 0.5);
+		if (histLength[t] <= histLength[t - 1])
+			histLength[t] = histLength[t - 1] + 1;
+	}
+	for (int t = 0; t < PERCEPTRON_TABLES; t++) {
+		fold[t].Init(histLength[t], logRows);
+		foldValue[t] = 0;
+	}
+
+	weights.assign((PERCEPTRON_TABLES << logRows) + 3, 0);
+	theta = (INT32) (1.93 * PERCEPTRON_TABLES + 14);
+	thetaCtr = 0;
+	sum = 0;
+}
+
+// index[t] = table t's row for this PC and table t's history fold
+void PREDICTOR_PERCEPTRON::ComputeIndices(UINT32 PC)
+{
+	UINT32 h = PC ^ (PC >> logRows);
+
+#if defined(PERCEPTRON_AVX2)
+	__m256i hv = _mm256_set1_epi32(h);
+	__m256i mask = _mm256_set1_epi32(rowMask);
+	__m128i shift = _mm_cvtsi32_si128(logRows);
+	for (int t = 0; t < PERCEPTRON_TABLES; t += 8) {
+		__m256i table = _mm256_sll_epi32(_mm256_setr_epi32(t, t + 1, t + 2, t + 3,
+								   t + 4, t + 5, t + 6, t + 7), shift);
+		__m256i f = _mm256_load_si256((const __m256i *) &foldValue[t]);
+		__m256i i = _mm256_or_si256(_mm256_and_si256(_mm256_xor_si256(f, hv), mask), table);
+		_mm256_store_si256((__m256i *) &index[t], i);
+	}
+#elif defined(PERCEPTRON_SSE2)
+	__m128i hv = _mm_set1_epi32(h);
+	__m128i mask = _mm_set1_epi32(rowMask);
+	__m128i shift = _mm_cvtsi32_si128(logRows);
+	for (int t = 0; t < PERCEPTRON_TABLES; t += 4) {
+		__m128i table = _mm_sll_epi32(_mm_setr_epi32(t, t + 1, t + 2, t + 3), shift);
+		__m128i f = _mm_load_si128((const __m128i *) &foldValue[t]);
+		__m128i i = _mm_or_si128(_mm_and_si128(_mm_xor_si128(f, hv), mask), table);
+		_mm_store_si128((__m128i *) &index[t], i);
+	}
+#else
+	for (int t = 0; t < PERCEPTRON_TABLES; t++)
+		index[t] = ((foldValue[t] ^ h) & rowMask) | (t << logRows);
+#endif
+}
+
+// selected[t] = weights[index[t]]
+void PREDICTOR_PERCEPTRON::GatherWeights()
+{
+#if defined(PERCEPTRON_AVX2)
+	// each gather lane loads the 4 bytes at its weight; keep byte 0 of
+	// every lane and pack the 8 bytes into the low quadword
+	const int *base = (const int *) &weights[0];
+	__m256i pick = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+					0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	__m256i compact = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+	__m128i half[2];
+	for (int k = 0; k < 2; k++) {
+		__m256i i = _mm256_load_si256((const __m256i *) &index[8 * k]);
+		__m256i w = _mm256_i32gather_epi32(base, i, 1);
+		w = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(w, pick), compact);
+		half[k] = _mm256_castsi256_si128(w);
+	}
+	_mm_store_si128((__m128i *) selected, _mm_unpacklo_epi64(half[0], half[1]));
+#else
+	for (int t = 0; t < PERCEPTRON_TABLES; t++)
+		selected[t] = weights[index[t]];
+#endif
+}
+
+INT32 PREDICTOR_PERCEPTRON::SumWeights()
+{
+#if defined(PERCEPTRON_SSE2)
+	// flipping the sign bit turns the weights into w + 128, which
+	// psadbw sums against zero into two 64-bit halves
+	__m128i w = _mm_load_si128((const __m128i *) selected);
+	__m128i s = _mm_sad_epu8(_mm_xor_si128(w, _mm_set1_epi8((char) 0x80)), _mm_setzero_si128());
+	return _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8)) - 128 * PERCEPTRON_TABLES;
+#else
+	INT32 total = 0;
+	for (int t = 0; t < PERCEPTRON_TABLES; t++)
+		total += selected[t];
+	return total;
+#endif
+}
+
+// moves every selected weight one step towards the outcome, saturating
+// at -128 and 127, and writes them back
+void PREDICTOR_PERCEPTRON::TrainWeights(bool taken)
+{
+#if defined(PERCEPTRON_SSE2)
+	__m128i w = _mm_load_si128((const __m128i *) selected);
+	w = _mm_adds_epi8(w, _mm_set1_epi8(taken ? 1 : -1));
+	_mm_store_si128((__m128i *) selected, w);
+#else
+	for (int t = 0; t < PERCEPTRON_TABLES; t++) {
+		if (taken) {
+			if (selected[t] < 127) selected[t]++;
+		} else {
+			if (selected[t] > -128) selected[t]--;
+		}
+	}
+#endif
+	for (int t = 0; t < PERCEPTRON_TABLES; t++)
+		weights[index[t]] = selected[t];
+}
+
+bool PREDICTOR_PERCEPTRON::GetPrediction(UINT32 PC)
+{
+	ComputeIndices(PC);
+	GatherWeights();
+	sum = SumWeights();
+	return sum >= 0;
+}
+
+void PREDICTOR_PERCEPTRON::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget)
+{
+	bool mispred = (sum >= 0) != resolveDir;
+
+	if (mispred || abs(sum) <= theta) {
+		TrainWeights(resolveDir);
+
+		// adapt theta so that mispredictions and low-confidence
+		// trainings happen about equally often
+		if (mispred) {
+			if (++thetaCtr >= 64) {
+				theta++;
+				thetaCtr = 0;
+			}
+		} else {
+			if (--thetaCtr <= -64) {
+				theta--;
+				thetaCtr = 0;
+			}
+		}
+	}
+
+	ghist.Push(resolveDir);
+	for (int t = 0; t < PERCEPTRON_TABLES; t++) {
+		fold[t].Update(ghist);
+		foldValue[t] = fold[t].Value();
+	}
+}
+
+void PREDICTOR_PERCEPTRON::Checkpoint(CHECKPOINT &cp)
+{
+	cp.Vector(weights);
+	cp.Value(ghist);
+	cp.Value(fold);
+	cp.Value(foldValue);
+	cp.Value(theta);
+	cp.Value(thetaCtr);
+}
+
+UINT64 PREDICTOR_PERCEPTRON::StorageBits()
+{
+	UINT64 bits = (UINT64) (PERCEPTRON_TABLES << logRows) * 8;
+
+	bits += histLength[PERCEPTRON_TABLES - 1];	// global history
+	bits += 8 + 7;					// theta and its counter
+	return bits;
+}
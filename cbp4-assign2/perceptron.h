@@ -0,0 +1,68 @@
+#ifndef _PERCEPTRON_H_
+#define _PERCEPTRON_H_
+
+#include "predictor.h"
+
+/////////////////////////////////////////////////////////////
+// hashed perceptron
+/////////////////////////////////////////////////////////////
+
+// A hashed perceptron: PERCEPTRON_TABLES tables of 8-bit weights, table t
+// indexed by the PC hashed with the newest histLength[t] outcomes of the
+// global history (folded to the row index width). Table 0 uses no history
+// and acts as the bias weight. The prediction is the sign of the sum of
+// the selected weights; the weights are trained on a misprediction or
+// when the sum is within the adaptive threshold theta.
+//
+// With one weight per table the work per branch is a gather of 16 bytes,
+// a horizontal sum and a saturating add of +-1, which map onto AVX2
+// (gather) or SSE2 (byte sums and saturating adds). The SIMD paths follow
+// the compiler's target (__AVX2__, __SSE2__); -DPERCEPTRON_SCALAR forces
+// the plain C++ loops, which give bit-identical results.
+
+#define PERCEPTRON_TABLES	16	// one SSE register of weights
+#define PERCEPTRON_MAX_HIST	1024
+
+#define perceptron_log_rows	10
+#define perceptron_history	256
+
+// perceptron:<log2 rows per table>:<longest history>
+class PREDICTOR_PERCEPTRON : public PREDICTOR{
+ private:
+  UINT32 logRows;
+  UINT32 rowMask;
+  UINT32 histLength[PERCEPTRON_TABLES];
+
+  // all tables back to back, table t at t << logRows, plus 3 bytes of
+  // padding so 4-byte gathers of the last weight stay inside the array
+  std::vector<INT8> weights;
+
+  HistoryRegister<PERCEPTRON_MAX_HIST> ghist;
+  FoldedHistory fold[PERCEPTRON_TABLES];
+  UINT32 foldValue[PERCEPTRON_TABLES] __attribute__((aligned(32)));
+
+  INT32  theta;
+  INT32  thetaCtr;
+
+  // state computed by GetPrediction and consumed by UpdatePredictor
+  UINT32 index[PERCEPTRON_TABLES] __attribute__((aligned(32)));
+  INT8   selected[PERCEPTRON_TABLES] __attribute__((aligned(16)));
+  INT32  sum;
+
+  void ComputeIndices(UINT32 PC);
+  void GatherWeights();
+  INT32 SumWeights();
+  void TrainWeights(bool taken);
+
+ public:
+  PREDICTOR_PERCEPTRON(UINT32 logRowsPerTable = perceptron_log_rows,
+		       UINT32 maxHistory = perceptron_history);
+
+  bool GetPrediction(UINT32 PC);
+  void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+  void Checkpoint(CHECKPOINT &cp);
+
+  UINT64 StorageBits();
+};
+
+#endif
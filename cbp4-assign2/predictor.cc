@@ -1,257 +1,301 @@
 #include "predictor.h"
+#include "tage.h"
+#include "perceptron.h"
 #include <string.h>
 #include <stdio.h>
-#include <bitset>
 
 //UINT32      unsigned int
 //INT32       int
 //UINT64      unsigned long long
 //COUNTER     unsigned long long
 
-#define counter_entries	4096
-#define two_level_width	64
-#define history_table_entries	512
-#define num_pattern_tables	8
 /////////////////////////////////////////////////////////////
 // 2bitsat
 /////////////////////////////////////////////////////////////
-static UINT32 two_bitcounter[counter_entries];
 
-void InitPredictor_2bitsat() 
+PREDICTOR_2BITSAT::PREDICTOR_2BITSAT(UINT32 logEntries) 
 {
-	int i;
-	for(i =0; i < counter_entries; i++)
-		two_bitcounter[i] = 1;
+	indexMask = (1 << logEntries) - 1;
+	two_bitcounter.Resize(1 << logEntries, 1);
 }
 
-bool GetPrediction_2bitsat(UINT32 PC) 
+bool PREDICTOR_2BITSAT::GetPrediction(UINT32 PC) 
 {
-	UINT32 tag = PC & 0xfff;
-	if(two_bitcounter[tag] > 1)
+	UINT32 tag = PC & indexMask;
+	if(two_bitcounter.IsTaken(tag))
 		return TAKEN;
 	else
 		return NOT_TAKEN;
 }
 
-void UpdatePredictor_2bitsat(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) 
+void PREDICTOR_2BITSAT::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) 
 {
-	UINT32 tag = PC & 0xfff;
-	unsigned short value = two_bitcounter[tag];
-	if(resolveDir == TAKEN)
-	{
-		if(value < 3)
-			two_bitcounter[tag] = value + 1;
-	}
-	else
-	{
-		if(value > 0)
-			two_bitcounter[tag] = value - 1;
-	}
+	UINT32 tag = PC & indexMask;
+	two_bitcounter.Update(tag, resolveDir);
+}
+
+void PREDICTOR_2BITSAT::Checkpoint(CHECKPOINT &cp)
+{
+	two_bitcounter.Checkpoint(cp);
+}
+
+UINT64 PREDICTOR_2BITSAT::StorageBits()
+{
+	return two_bitcounter.StorageBits();
 }
 
 /////////////////////////////////////////////////////////////
 // 2level
 /////////////////////////////////////////////////////////////
-static UINT32 historyreg[history_table_entries];			//branch history register that is 2^9 = 512 entries index by PC [11:3]
-static UINT32 patterntable[num_pattern_tables][two_level_width];	//8 pattern history tables each with 2^6 entries since the predictor is tracking 6 history bits
+// historyreg:   branch history registers, by default 2^9 = 512 entries index by PC [11:3]
+// patterntable: pattern history tables (8 by default, picked by PC [2:0]) each with
+//               2^historyLength entries since that is how many history bits are tracked
 
-void InitPredictor_2level() 
+PREDICTOR_2LEVEL::PREDICTOR_2LEVEL(UINT32 logHistoryEntries, UINT32 historyLength,
+				   UINT32 numPatternTables) 
 {
-	int i,j;
-	for(i =0; i < history_table_entries; i++)
-		historyreg[i] = 0;
-	for(i =0; i < num_pattern_tables; i++)
-	{
-		for(j = 0; j < two_level_width; j++)
-			patterntable[i][j] = 1;
-	}
+	patternBits = 0;
+	while((1u << patternBits) < numPatternTables)
+		patternBits++;
+	historyMask = (1 << logHistoryEntries) - 1;
+	widthMask = (1 << historyLength) - 1;
+
+	historyreg.assign(1 << logHistoryEntries, 0);
+	patterntable.Resize((1 << patternBits) << historyLength, 1);
 }
 
-bool GetPrediction_2level(UINT32 PC) 
+bool PREDICTOR_2LEVEL::GetPrediction(UINT32 PC) 
 {
-	UINT32 historytag = PC & 0b111111111000;
-	historytag = historytag >> 3;
-	UINT32 patterntag = PC & 0b111;		//which PHT table
+	UINT32 historytag = (PC >> patternBits) & historyMask;
+	UINT32 patterntag = PC & ((1 << patternBits) - 1);		//which PHT table
+	UINT32 base = patterntag * (widthMask + 1);
 
-	if(patterntable[patterntag][historyreg[historytag]] > 1)
+	if(patterntable.IsTaken(base + historyreg[historytag]))
 		return TAKEN;
 	else
 		return NOT_TAKEN;
-	return TAKEN;
 }
 
-void UpdatePredictor_2level(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) 
+void PREDICTOR_2LEVEL::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) 
 {
-	UINT32 historytag = PC & 0b111111111000;
-	historytag = historytag >> 3;
-	UINT32 patterntag = PC & 0b111;
+	UINT32 historytag = (PC >> patternBits) & historyMask;
+	UINT32 patterntag = PC & ((1 << patternBits) - 1);
+	UINT32 base = patterntag * (widthMask + 1);
 	
 	//updates the branch history register
 	UINT32 history = historyreg[historytag];
-	historyreg[historytag] = ((history << 1) | resolveDir) & 0b111111;
+	historyreg[historytag] = ((history << 1) | resolveDir) & widthMask;
 
 	//updates the pattern history table
-	UINT32 value = patterntable[patterntag][history];
-	if(resolveDir == TAKEN)
-	{
-		if(value < 3)
-			patterntable[patterntag][history] = value + 1;
-	}
-	else
-	{
-		if(value > 0)
-			patterntable[patterntag][history] = value - 1;
-	}
+	patterntable.Update(base + history, resolveDir);
+}
+
+void PREDICTOR_2LEVEL::Checkpoint(CHECKPOINT &cp)
+{
+	cp.Vector(historyreg);
+	patterntable.Checkpoint(cp);
+}
+
+UINT64 PREDICTOR_2LEVEL::StorageBits()
+{
+	UINT32 historyLength = 0;
+	while ((1u << historyLength) <= widthMask)
+		historyLength++;
+	return (UINT64) historyreg.size() * historyLength + patterntable.StorageBits();
 }
 
 /////////////////////////////////////////////////////////////
-// openend
+// gshare
 /////////////////////////////////////////////////////////////
+// The newest outcome enters the GHR at its top bit.
 
-bitset<15> GHR;
-int openendPHT[3][1 << 14];
-int twobitOpen[32768];
-int gshare_counter;
-int twobit_counter;
-int inst_counter;
-int inst_counter_limit = 256000;
-int gshare_PHT[1<<15];
-
-template <int N1, int N2>
-bitset <N1 + N2> bitset_concat(const bitset<N1> &b1, const bitset<N2> &b2) {
-    string s1 = b1.to_string();
-    string s2 = b2.to_string();
-    return bitset<N1+N2> (s1 + s2);
+PREDICTOR_GSHARE::PREDICTOR_GSHARE(UINT32 historyLength)
+{
+	historyBits = historyLength;
+	indexMask = (1 << historyLength) - 1;
+	GHR = 0;
+	gshare_PHT.Resize(1 << historyLength, 3);
 }
 
-template <int N>
-bitset<N> bitset_hash(bitset<N> V) {
-    bool last_bit = V[N-1];
-    bool first_bit = V[0];
-    V = V >> 1;
-    V[N-1] = last_bit ^ first_bit;
-    return V;
+bool PREDICTOR_GSHARE::GetPrediction(UINT32 PC)
+{
+	UINT32 f = (PC ^ GHR) & indexMask;
+	if (gshare_PHT.IsTaken(f)) return TAKEN;
+	return NOT_TAKEN;
 }
 
-template <int N>
-bitset<N> bitset_invhash(bitset<N> V) {
-    bool n_xor_1_bit = V[N-1];
-    bool n_bit = V[N-2];
-    V = V << 1;
-    V[0] = n_xor_1_bit ^ n_bit;
-    return V;
+void PREDICTOR_GSHARE::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget)
+{
+	UINT32 f = (PC ^ GHR) & indexMask;
+	gshare_PHT.Update(f, resolveDir);
+	GHR = (GHR >> 1) | ((UINT32) resolveDir << (historyBits - 1));
 }
 
-template <int N>
-bitset<N> get_f1(bitset<N> V1, bitset<N> V2) {
-    return (bitset_hash<N>(V1) ^ bitset_invhash<N>(V2) ^ V2);
+void PREDICTOR_GSHARE::Checkpoint(CHECKPOINT &cp)
+{
+	cp.Value(GHR);
+	gshare_PHT.Checkpoint(cp);
 }
-template <int N>
-bitset<N> get_f2(bitset<N> V1, bitset<N> V2) {
-    return (bitset_hash<N>(V1) ^ bitset_invhash<N>(V2) ^ V1);
+
+UINT64 PREDICTOR_GSHARE::StorageBits()
+{
+	return historyBits + gshare_PHT.StorageBits();
 }
-template <int N>
-bitset<N> get_f3(bitset<N> V1, bitset<N> V2) {
-    return (bitset_invhash<N>(V1) ^ bitset_hash<N>(V2) ^ V2);
+
+/////////////////////////////////////////////////////////////
+// registry
+/////////////////////////////////////////////////////////////
+
+typedef PREDICTOR *(*PREDICTOR_FACTORY)(const std::vector<UINT32> &args);
+
+static PREDICTOR *Create2bitsat(const std::vector<UINT32> &args)
+{
+	if (args[0] < 1 || args[0] > 30) return NULL;
+	return new PREDICTOR_2BITSAT(args[0]);
+}
+
+static PREDICTOR *Create2level(const std::vector<UINT32> &args)
+{
+	if (args[0] > 30 || args[1] < 1 || args[1] > 24 || args[2] < 1 || args[2] > 1024)
+		return NULL;
+	// the pattern tables are picked by PC bits, so their count is a power
+	// of two, and all of them together hold at most 2^30 counters
+	if (args[2] & (args[2] - 1))
+		return NULL;
+	UINT32 patternBits = 0;
+	while ((1u << patternBits) < args[2])
+		patternBits++;
+	if (patternBits + args[1] > 30)
+		return NULL;
+	return new PREDICTOR_2LEVEL(args[0], args[1], args[2]);
 }
 
-bitset<14> V1;
-bitset<14> V2;
-void InitPredictor_openend() {
-    for (int i = 0; i < (1 << 15); i++)
-        gshare_PHT[i] = 3;
+static PREDICTOR *CreateGshare(const std::vector<UINT32> &args)
+{
+	if (args[0] < 1 || args[0] > 30) return NULL;
+	return new PREDICTOR_GSHARE(args[0]);
 }
 
-bool GetPrediction_openend(UINT32 PC) {
-    /*
-    bitset<32> bitset_PC(PC);
-    bitset<40> V = bitset_concat<32,8>(bitset_PC, GHR);
-    bitset<14> V1(V.to_string().substr(26,14));
-    bitset<14> V2(V.to_string().substr(12,14));
-    UINT32 f1 = get_f1<14>(V1,V2).to_ulong();
-    UINT32 f2 = get_f2<14>(V1,V2).to_ulong();
-    UINT32 f3 = get_f3<14>(V1,V2).to_ulong();
-    f1 = f1 & ((1 << 14) - 1);
-    f2 = f2 & ((1 << 14) - 1);
-    f3 = f3 & ((1 << 14) - 1);
-    
-    int not_taken_counter = 0;
-    if (openendPHT[0][f1] < 2) not_taken_counter++;
-    if (openendPHT[1][f2] < 2) not_taken_counter++;
-    if (openendPHT[2][f3] < 2) not_taken_counter++;
-    //printf("f1 %d f2 %d f3 %d count %d\n", f1, f2, f3, not_taken_counter); 
-    if (not_taken_counter >= 2) return NOT_TAKEN;
-    return TAKEN;*/
-    UINT32 f = PC ^ GHR.to_ulong();
-    f = f & ((1 << 15) - 1);
-    //printf("f: %d\n", f);
-    if (gshare_PHT[f] >= 4) return TAKEN;
-    return NOT_TAKEN;
+static PREDICTOR *CreateTage(const std::vector<UINT32> &args)
+{
+	return new PREDICTOR_TAGE_SC_L();
 }
 
-void UpdatePredictor_openend(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
-    /*
-    bitset<32> bitset_PC(PC);
-    bitset<40> V = bitset_concat<32,8>(bitset_PC, GHR);
-    bitset<14> V1(V.to_string().substr(26,14));
-    bitset<14> V2(V.to_string().substr(12,14));
-    UINT32 f1 = get_f1<14>(V1,V2).to_ulong();
-    UINT32 f2 = get_f2<14>(V1,V2).to_ulong();
-    UINT32 f3 = get_f3<14>(V1,V2).to_ulong();
-    f1 = f1 & ((1 << 14) - 1);
-    f2 = f2 & ((1 << 14) - 1);
-    f3 = f3 & ((1 << 14) - 1);
-    
-    // update history table
-    GHR <<= 1;
-    if (resolveDir == TAKEN) GHR |= 1;
-    // update three banks
-    if (resolveDir == predDir) {
-        if (resolveDir == TAKEN) {
-            if (openendPHT[0][f1] == 2) openendPHT[0][f1]++;
-            if (openendPHT[1][f2] == 2) openendPHT[1][f2]++;
-            if (openendPHT[2][f3] == 2) openendPHT[2][f3]++;
-        }
-        else {
-            if (openendPHT[0][f1] == 1) openendPHT[0][f1]--;
-            if (openendPHT[1][f2] == 1) openendPHT[1][f2]--;
-            if (openendPHT[2][f3] == 1) openendPHT[2][f3]--;
-        }
-    } else {
-        if (resolveDir == TAKEN) {
-            if (openendPHT[0][f1] != 3) openendPHT[0][f1]++;
-            if (openendPHT[1][f2] != 3) openendPHT[1][f2]++;
-            if (openendPHT[2][f3] != 3) openendPHT[2][f3]++;
-        } else {
-            if (openendPHT[0][f1] != 0) openendPHT[0][f1]--;
-            if (openendPHT[1][f2] != 0) openendPHT[1][f2]--;
-            if (openendPHT[2][f3] != 0) openendPHT[2][f3]--;
-        }
-    }
-
- */
-    UINT32 f = PC ^ GHR.to_ulong();
-    f = f & ((1 << 15) - 1);
-    if (resolveDir == TAKEN) {
-        if (gshare_PHT[f] != 7) gshare_PHT[f]++;
-    } else {
-        if (gshare_PHT[f] != 0) gshare_PHT[f]--;
-    }
-    GHR >>= 1;
-    if (resolveDir == TAKEN) GHR[14] = 1;
+static PREDICTOR *CreatePerceptron(const std::vector<UINT32> &args)
+{
+	if (args[0] < 4 || args[0] > 24 || args[1] < 2 || args[1] > PERCEPTRON_MAX_HIST)
+		return NULL;
+	return new PREDICTOR_PERCEPTRON(args[0], args[1]);
+}
+
+static struct {
+	const char        *name;
+	const char        *usage;
+	UINT32             numArgs;
+	UINT32             defaults[4];
+	PREDICTOR_FACTORY  factory;
+} registry[] = {
+	{ "2bitsat", "2bitsat[:<log2 counters>]",                                  1, { 12 },       Create2bitsat },
+	{ "2level",  "2level[:<log2 history regs>[:<history bits>[:<pattern tables>]]]", 3, { 9, 6, 8 }, Create2level },
+	{ "gshare",  "gshare[:<history bits>]",                                    1, { gshare_history_bits }, CreateGshare },
+	{ "perceptron", "perceptron[:<log2 rows per table>[:<longest history>]]",   2, { perceptron_log_rows, perceptron_history }, CreatePerceptron },
+	{ "openend", "openend (TAGE-SC-L, TAGE_BUDGET_KB at compile time)",      0, { 0 },        CreateTage },
+	{ "tage",    "tage (same as openend)",                                     0, { 0 },        CreateTage },
+};
+
+bool SpecNameIs(const char *spec, const char *name)
+{
+	const char *colon = strchr(spec, ':');
+	size_t nameLen = colon ? (size_t)(colon - spec) : strlen(spec);
+
+	return strlen(name) == nameLen && strncmp(spec, name, nameLen) == 0;
+}
+
+bool ParseSpecArgs(const char *spec, UINT32 numArgs, const UINT32 *defaults, std::vector<UINT32> &args)
+{
+	const char *p = strchr(spec, ':');
+
+	args.assign(defaults, defaults + numArgs);
+	for (UINT32 a = 0; p != NULL; a++) {
+		char *end;
+		if (a >= numArgs) return false;
+		args[a] = strtoul(p + 1, &end, 0);
+		if (end == p + 1 || (*end != ':' && *end != '\0')) return false;
+		p = (*end == ':') ? end : NULL;
+	}
+	return true;
 }
 
-/*
-void InitPredictor_openend() {
+// the values one grid argument stands for
+static bool ExpandGridArg(const std::string &arg, std::vector<std::string> &values)
+{
+	size_t pos = 0;
+
+	while (pos <= arg.size()) {
+		size_t comma = arg.find(',', pos);
+		std::string item = arg.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+		char *end;
+		UINT32 lo = strtoul(item.c_str(), &end, 0), hi = lo;
 
+		if (end == item.c_str())
+			return false;
+		if (*end == '-') {
+			const char *p = end + 1;
+			hi = strtoul(p, &end, 0);
+			if (end == p || hi < lo || hi - lo > 1024)
+				return false;
+		}
+		if (*end != '\0')
+			return false;
+		for (UINT32 v = lo; v <= hi; v++)
+			values.push_back(std::to_string(v));
+
+		if (comma == std::string::npos)
+			break;
+		pos = comma + 1;
+	}
+	return true;
 }
 
-bool GetPrediction_openend(UINT32 PC) {
+bool ExpandSpecGrid(const char *grid, std::vector<std::string> &specs)
+{
+	const char *colon = strchr(grid, ':');
+	std::vector<std::string> partial(1, std::string(grid, colon ? colon - grid : strlen(grid)));
+
+	while (colon != NULL) {
+		const char *next = strchr(colon + 1, ':');
+		std::string arg(colon + 1, next ? next - colon - 1 : strlen(colon + 1));
+		std::vector<std::string> values, expanded;
 
-  return TAKEN;
+		if (!ExpandGridArg(arg, values))
+			return false;
+		for (size_t i = 0; i < partial.size(); i++)
+			for (size_t v = 0; v < values.size(); v++)
+				expanded.push_back(partial[i] + ":" + values[v]);
+		partial.swap(expanded);
+		colon = next;
+	}
+
+	specs.insert(specs.end(), partial.begin(), partial.end());
+	return true;
 }
 
-void UpdatePredictor_openend(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+PREDICTOR *CreatePredictor(const char *spec)
+{
+	for (size_t i = 0; i < sizeof(registry) / sizeof(registry[0]); i++) {
+		if (!SpecNameIs(spec, registry[i].name))
+			continue;
 
+		std::vector<UINT32> args;
+		if (!ParseSpecArgs(spec, registry[i].numArgs, registry[i].defaults, args))
+			return NULL;
+		return registry[i].factory(args);
+	}
+	return NULL;
+}
+
+void PrintPredictorUsage(FILE *out)
+{
+	for (size_t i = 0; i < sizeof(registry) / sizeof(registry[0]); i++)
+		fprintf(out, "  --pred %s\n", registry[i].usage);
 }
-*/
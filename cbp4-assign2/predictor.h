@@ -3,26 +3,114 @@
 
 #include "utils.h"
 #include "tracer.h"
+#include "satcounter.h"
+#include "history.h"
+#include "checkpoint.h"
+#include <vector>
 
+// default geometries, overridable per instance from the command line
+#define counter_entries	4096
+#define two_level_width	64
+#define history_table_entries	512
+#define num_pattern_tables	8
+
+#define gshare_history_bits	15
+
+/////////////////////////////////////////////////////////////
+// common interface
 /////////////////////////////////////////////////////////////
 
-void InitPredictor_2bitsat();
-bool GetPrediction_2bitsat(UINT32 PC);  
-void UpdatePredictor_2bitsat(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+// Each predictor keeps all of its state in the instance, so several traces
+// can be simulated side by side, each with predictors of its own.
+// Checkpoint() saves or restores that state (tables and histories, not
+// the scratch values passed from GetPrediction to UpdatePredictor).
+// StorageBits() is the hardware budget the instance models.
+
+class PREDICTOR{
+ public:
+  virtual ~PREDICTOR(){}
+
+  virtual bool GetPrediction(UINT32 PC) = 0;  
+  virtual void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) = 0;
+  virtual void Checkpoint(CHECKPOINT &cp) = 0;
+  virtual UINT64 StorageBits() = 0;
+};
+
+// Builds a predictor from a "name[:arg[:arg...]]" spec, e.g. "gshare:15"
+// or "2level:9:6:8". Returns NULL for an unknown name or bad arguments.
+PREDICTOR *CreatePredictor(const char *spec);
+
+// Lists the registered names and their arguments.
+void PrintPredictorUsage(FILE *out);
+
+// Spec helpers shared by the registries: SpecNameIs() matches the part
+// before the first ':', ParseSpecArgs() fills args with up to numArgs
+// colon-separated values over the defaults and fails on anything else.
+bool SpecNameIs(const char *spec, const char *name);
+bool ParseSpecArgs(const char *spec, UINT32 numArgs, const UINT32 *defaults, std::vector<UINT32> &args);
+
+// Expands a grid spec into the specs it covers, e.g. "2level:8-10:4,6"
+// into 2level:8:4, 2level:8:6, 2level:9:4, ... Each argument is a value,
+// a range lo-hi or a comma-separated list of those; false if malformed.
+bool ExpandSpecGrid(const char *grid, std::vector<std::string> &specs);
 
 /////////////////////////////////////////////////////////////
 
-void InitPredictor_2level();
-bool GetPrediction_2level(UINT32 PC);  
-void UpdatePredictor_2level(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+// 2bitsat:<log2 counters>
+class PREDICTOR_2BITSAT : public PREDICTOR{
+ private:
+  UINT32 indexMask;
+  SatCounterTable<2> two_bitcounter;
+
+ public:
+  PREDICTOR_2BITSAT(UINT32 logEntries = 12);
+
+  bool GetPrediction(UINT32 PC);  
+  void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+  void Checkpoint(CHECKPOINT &cp);
+  UINT64 StorageBits();
+};
 
 /////////////////////////////////////////////////////////////
 
-void InitPredictor_openend();
-bool GetPrediction_openend(UINT32 PC);  
-void UpdatePredictor_openend(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+// 2level:<log2 history registers>:<history bits>:<pattern tables>
+class PREDICTOR_2LEVEL : public PREDICTOR{
+ private:
+  UINT32 historyMask;      // one history register per PC[historyBits+patternBits-1:patternBits]
+  UINT32 patternBits;      // log2 of the number of pattern tables, selected by the low PC bits
+  UINT32 widthMask;        // history length in bits
+  std::vector<UINT32> historyreg;
+  SatCounterTable<2> patterntable;
+
+ public:
+  PREDICTOR_2LEVEL(UINT32 logHistoryEntries = 9, UINT32 historyLength = 6,
+		   UINT32 numPatternTables = num_pattern_tables);
+
+  bool GetPrediction(UINT32 PC);  
+  void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+  void Checkpoint(CHECKPOINT &cp);
+  UINT64 StorageBits();
+};
 
 /////////////////////////////////////////////////////////////
 
-#endif
+// gshare:<history bits>, 3-bit counters
+class PREDICTOR_GSHARE : public PREDICTOR{
+ private:
+  UINT32 historyBits;
+  UINT32 indexMask;
+  UINT32 GHR;
+  SatCounterTable<3> gshare_PHT;
+
+ public:
+  PREDICTOR_GSHARE(UINT32 historyLength = gshare_history_bits);
 
+  bool GetPrediction(UINT32 PC);  
+  void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+  void Checkpoint(CHECKPOINT &cp);
+  UINT64 StorageBits();
+};
+
+/////////////////////////////////////////////////////////////
+
+#endif
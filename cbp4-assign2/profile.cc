@@ -0,0 +1,108 @@
+#include "profile.h"
+#include <algorithm>
+
+/////////////////////////////////////////////////////////////
+// per-static-branch profile
+/////////////////////////////////////////////////////////////
+
+#define PROFILE_INITIAL_SLOTS	(1 << 12)
+
+BRANCH_PROFILE::BRANCH_PROFILE(UINT32 numPredictors)
+{
+	numPreds = numPredictors;
+	mask = PROFILE_INITIAL_SLOTS - 1;
+	numBranches = 0;
+
+	pc.assign(PROFILE_INITIAL_SLOTS, 0);
+	used.assign(PROFILE_INITIAL_SLOTS, 0);
+	executions.assign(PROFILE_INITIAL_SLOTS, 0);
+	taken.assign(PROFILE_INITIAL_SLOTS, 0);
+	mispred.assign((size_t) PROFILE_INITIAL_SLOTS * numPreds, 0);
+}
+
+// doubles the table and reinserts every branch
+void BRANCH_PROFILE::Grow()
+{
+	BRANCH_PROFILE bigger(0);
+	UINT32 slots = 2 * (mask + 1);
+
+	bigger.numPreds = numPreds;
+	bigger.mask = slots - 1;
+	bigger.pc.assign(slots, 0);
+	bigger.used.assign(slots, 0);
+	bigger.executions.assign(slots, 0);
+	bigger.taken.assign(slots, 0);
+	bigger.mispred.assign((size_t) slots * numPreds, 0);
+
+	for (UINT32 s = 0; s <= mask; s++) {
+		if (!used[s])
+			continue;
+
+		UINT32 d = Hash(pc[s]) & bigger.mask;
+		while (bigger.used[d])
+			d = (d + 1) & bigger.mask;
+
+		bigger.used[d] = 1;
+		bigger.pc[d] = pc[s];
+		bigger.executions[d] = executions[s];
+		bigger.taken[d] = taken[s];
+		for (UINT32 p = 0; p < numPreds; p++)
+			bigger.mispred[(size_t) d * numPreds + p] = mispred[(size_t) s * numPreds + p];
+	}
+	bigger.numBranches = numBranches;
+
+	*this = bigger;
+}
+
+void BRANCH_PROFILE::PrintTop(FILE *out, UINT32 n, UINT32 pred, const char *label) const
+{
+	std::vector<std::pair<UINT64, UINT32> > order;	// (mispredictions, slot)
+	UINT64 total = 0;
+
+	for (UINT32 s = 0; s <= mask; s++) {
+		if (!used[s])
+			continue;
+		UINT64 m = mispred[(size_t) s * numPreds + pred];
+		order.push_back(std::make_pair(m, s));
+		total += m;
+	}
+
+	n = std::min<UINT32>(n, order.size());
+	std::partial_sort(order.begin(), order.begin() + n, order.end(),
+			  std::greater<std::pair<UINT64, UINT32> >());
+
+	fprintf(out, "\n%-8s HARD_BRANCHES: top %u of %u static branches\n", label, n, numBranches);
+	fprintf(out, "  %-10s %12s %8s %12s %8s %8s %8s\n",
+		"PC", "EXECUTIONS", "TAKEN%", "MISPRED", "MISP%", "SHARE%", "CUMUL%");
+
+	UINT64 cumul = 0;
+	for (UINT32 i = 0; i < n; i++) {
+		UINT32 s = order[i].second;
+		UINT64 m = order[i].first;
+		cumul += m;
+		fprintf(out, "  0x%08x %12llu %8.2f %12llu %8.2f %8.2f %8.2f\n",
+			pc[s], executions[s], 100.0 * taken[s] / executions[s],
+			m, 100.0 * m / executions[s],
+			total ? 100.0 * m / total : 0.0, total ? 100.0 * cumul / total : 0.0);
+	}
+}
+
+void BRANCH_PROFILE::WriteCsv(FILE *out, const char *traceName, bool header,
+			      const std::vector<const char *> &specs) const
+{
+	if (header) {
+		fprintf(out, "trace,pc,executions,taken");
+		for (size_t p = 0; p < specs.size(); p++)
+			fprintf(out, ",%s", specs[p]);
+		fprintf(out, "\n");
+	}
+
+	for (UINT32 s = 0; s <= mask; s++) {
+		if (!used[s])
+			continue;
+		fprintf(out, "%s,0x%08x,%llu,%llu", traceName, pc[s], executions[s], taken[s]);
+		for (UINT32 p = 0; p < numPreds; p++)
+			fprintf(out, ",%llu", mispred[(size_t) s * numPreds + p]);
+		fprintf(out, "\n");
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include "utils.h"
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+// per-static-branch profile
+/////////////////////////////////////////////////////////////
+
+// BRANCH_PROFILE counts, for every static conditional branch, how often
+// it executed, how often it was taken and how often each predictor
+// mispredicted it. Branches live in an open-addressing table (linear
+// probing, power-of-two size, at most half full) whose columns are flat
+// arrays; it grows by rehashing, which moves every slot. Reserve() grows it
+// ahead of time, so that slots taken after it stay valid.
+
+class BRANCH_PROFILE{
+ private:
+  UINT32 numPreds;
+  UINT32 mask;
+  UINT32 numBranches;
+  std::vector<UINT32> pc;
+  std::vector<UINT8>  used;
+  std::vector<UINT64> executions;
+  std::vector<UINT64> taken;
+  std::vector<UINT64> mispred;     // [slot * numPreds + predictor]
+
+  static UINT32 Hash(UINT32 PC){ return (PC * 0x9e3779b1u) ^ (PC >> 15); }
+  void   Grow();
+
+ public:
+  BRANCH_PROFILE(UINT32 numPredictors);
+
+  // slot of PC, inserted if new; counts one execution with outcome taken
+  UINT32 Record(UINT32 PC, bool isTaken){
+    UINT32 slot = Hash(PC) & mask;
+
+    while (used[slot] && pc[slot] != PC) {
+      slot = (slot + 1) & mask;
+    }
+    if (!used[slot]) {
+      if (2 * (numBranches + 1) > mask + 1) {
+        Grow();
+        return Record(PC, isTaken);
+      }
+      used[slot] = 1;
+      pc[slot] = PC;
+      numBranches++;
+    }
+    executions[slot]++;
+    taken[slot] += isTaken;
+    return slot;
+  }
+
+  void Mispredict(UINT32 slot, UINT32 pred){ mispred[(size_t) slot * numPreds + pred]++; }
+
+  // room for n more branches, so the next n Record()s move no slot
+  void Reserve(UINT32 n){
+    while (2 * (numBranches + n) > mask + 1) {
+      Grow();
+    }
+  }
+
+  UINT32 NumBranches() const { return numBranches; }
+
+  // the n branches predictor pred mispredicts most, one line each
+  void PrintTop(FILE *out, UINT32 n, UINT32 pred, const char *label) const;
+
+  // every branch, one row each: trace,pc,executions,taken,<spec>...
+  void WriteCsv(FILE *out, const char *traceName, bool header,
+		const std::vector<const char *> &specs) const;
+};
+
+#endif
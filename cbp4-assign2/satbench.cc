@@ -0,0 +1,114 @@
+// Microbenchmark for SatCounterTable: lookup+update throughput of packed
+// counter tables against the UINT32-per-counter tables with branchy
+// saturation that predictor.cc used before.
+//
+// usage: satbench [<million updates>]
+
+#include "utils.h"
+#include "satcounter.h"
+
+#include <chrono>
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+
+// the former representation: one UINT32 per counter, if-guarded steps
+template <UINT32 Bits>
+class PlainCounterTable{
+  std::vector<UINT32> table;
+
+ public:
+  void Resize(UINT32 entries, UINT32 init){ table.assign(entries, init); }
+  bool IsTaken(UINT32 i) const { return table[i] > ((1u << Bits) - 1) / 2; }
+  void Update(UINT32 i, bool taken){
+    UINT32 value = table[i];
+    if(taken){
+      if(value < (1u << Bits) - 1)
+	table[i] = value + 1;
+    }
+    else{
+      if(value > 0)
+	table[i] = value - 1;
+    }
+  }
+};
+
+/////////////////////////////////////////////////////////////
+
+static std::vector<UINT32> indices;
+static std::vector<UINT8>  outcomes;
+
+// index stream: random entries, outcome mostly follows the entry's low bit
+// so the counters see a mix of saturating runs and flips
+static void MakeStream(UINT32 n, UINT32 entries){
+  UINT32 x = 2463534242u;
+
+  indices.resize(n);
+  outcomes.resize(n);
+  for(UINT32 i = 0; i < n; i++){
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    indices[i] = x & (entries - 1);
+    outcomes[i] = (indices[i] & 1) ^ ((x >> 28) == 0);
+  }
+}
+
+template <class TABLE>
+static void Run(const char *name, TABLE *table, UINT32 entries, UINT32 footprint){
+  UINT64 correct = 0;
+  UINT32 n = indices.size();
+
+  auto start = std::chrono::steady_clock::now();
+  for(UINT32 i = 0; i < n; i++){
+    UINT32 idx = indices[i];
+    bool   taken = outcomes[i];
+
+    correct += (table->IsTaken(idx) == taken);
+    table->Update(idx, taken);
+  }
+  auto stop = std::chrono::steady_clock::now();
+
+  double secs = std::chrono::duration<double>(stop - start).count();
+  printf("%-28s %8u entries %9u bytes  %8.1f M updates/s  (accuracy %.4f)\n",
+	 name, entries, footprint, n / secs / 1e6, (double) correct / n);
+}
+
+template <UINT32 Bits, UINT32 Entries>
+static void Compare(UINT32 n){
+  char name[64];
+
+  MakeStream(n, Entries);
+
+  PlainCounterTable<Bits> *plain = new PlainCounterTable<Bits>();
+  plain->Resize(Entries, 1);
+  sprintf(name, "UINT32 %u-bit", Bits);
+  Run(name, plain, Entries, Entries * 4);
+  delete plain;
+
+  SatCounterTable<Bits> *dynamic = new SatCounterTable<Bits>();
+  dynamic->Resize(Entries, 1);
+  sprintf(name, "SatCounterTable<%u>", Bits);
+  Run(name, dynamic, Entries, dynamic->StorageBytes());
+  delete dynamic;
+
+  SatCounterTable<Bits, Entries> *fixed = new SatCounterTable<Bits, Entries>();
+  fixed->Fill(1);
+  sprintf(name, "SatCounterTable<%u, %u>", Bits, Entries);
+  Run(name, fixed, Entries, fixed->StorageBytes());
+  delete fixed;
+
+  printf("\n");
+}
+
+int main(int argc, char *argv[]){
+  UINT32 n = 50;
+
+  if(argc > 1){
+    n = atoi(argv[1]);
+  }
+  n *= 1000000;
+
+  Compare<2, 4096>(n);        // 2bitsat
+  Compare<2, 512>(n);         // one 2level configuration's pattern tables
+  Compare<3, 32768>(n);       // gshare / openend
+  Compare<2, 1 << 22>(n);     // larger than L2 as UINT32s
+}
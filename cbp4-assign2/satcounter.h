@@ -0,0 +1,112 @@
+#ifndef _SATCOUNTER_H_
+#define _SATCOUNTER_H_
+
+#include "utils.h"
+#include "checkpoint.h"
+#include <string.h>
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+// packed saturating counter tables
+/////////////////////////////////////////////////////////////
+
+// SatCounterTable<Bits, Entries> holds Entries unsigned counters of Bits
+// bits each, saturating at 0 and 2^Bits-1. Counters of up to 4 bits are
+// packed two to a byte, wider ones (up to 8 bits) take a byte each.
+// Entries == 0 leaves the size to Resize(), for geometries chosen at
+// runtime; otherwise the table is a plain array inside the object.
+//
+// Update() is branch-free: the step is computed from the outcome and the
+// two saturation tests instead of being selected by ifs.
+
+template <UINT32 Bytes>
+struct SatCounterStorage{
+  UINT8 data[Bytes];
+
+  UINT8 *Ptr(){ return data; }
+  const UINT8 *Ptr() const { return data; }
+  void Resize(UINT32 bytes){}
+};
+
+template <>
+struct SatCounterStorage<0>{
+  std::vector<UINT8> data;
+
+  UINT8 *Ptr(){ return &data[0]; }
+  const UINT8 *Ptr() const { return &data[0]; }
+  void Resize(UINT32 bytes){ data.assign(bytes, 0); }
+};
+
+template <UINT32 Bits, UINT32 Entries = 0>
+class SatCounterTable{
+  static_assert(Bits >= 1 && Bits <= 8, "counters are 1 to 8 bits wide");
+
+ public:
+  static const UINT32 MAX = (1 << Bits) - 1;
+  static const UINT32 PACK_SHIFT = (Bits <= 4) ? 1 : 0;    // log2 counters per byte
+  static const UINT32 FIELD_BITS = (Bits <= 4) ? 4 : 8;
+  static const UINT32 FIELD_MASK = (1 << FIELD_BITS) - 1;
+  static const UINT32 BYTES = (Entries + (1 << PACK_SHIFT) - 1) >> PACK_SHIFT;
+
+ private:
+  SatCounterStorage<BYTES> storage;
+  UINT32 numEntries;
+
+  static UINT32 Bytes(UINT32 entries){ return (entries + (1 << PACK_SHIFT) - 1) >> PACK_SHIFT; }
+  static UINT32 Shift(UINT32 i){ return (i & ((1 << PACK_SHIFT) - 1)) * FIELD_BITS; }
+
+ public:
+  SatCounterTable(){
+    numEntries = Entries;
+    if (Entries) Fill(0);
+  }
+
+  // (re)sizes a runtime-sized table; every counter starts at init
+  void Resize(UINT32 entries, UINT32 init){
+    numEntries = entries;
+    storage.Resize(Bytes(entries));
+    Fill(init);
+  }
+
+  void Fill(UINT32 init){
+    UINT8 byte = (PACK_SHIFT) ? (UINT8)(init | (init << 4)) : (UINT8) init;
+    memset(storage.Ptr(), byte, Bytes(numEntries));
+  }
+
+  UINT32 Size() const { return numEntries; }
+  UINT64 StorageBits() const { return (UINT64) numEntries * Bits; }     // modeled hardware budget
+  UINT32 StorageBytes() const { return Bytes(numEntries); }              // host memory footprint
+
+  UINT32 Get(UINT32 i) const {
+    return (storage.Ptr()[i >> PACK_SHIFT] >> Shift(i)) & FIELD_MASK;
+  }
+
+  void Set(UINT32 i, UINT32 value){
+    UINT8 *b = &storage.Ptr()[i >> PACK_SHIFT];
+    UINT32 s = Shift(i);
+    *b = (UINT8)((*b & ~(FIELD_MASK << s)) | (value << s));
+  }
+
+  // saves or restores the counters; the sizes must already agree
+  void Checkpoint(CHECKPOINT &cp){
+    UINT32 n = numEntries;
+    cp.Value(n);
+    if (n != numEntries) cp.Fail();
+    cp.IO(storage.Ptr(), Bytes(numEntries));
+  }
+
+  // upper half of the counter range means taken
+  bool IsTaken(UINT32 i) const { return Get(i) > (MAX >> 1); }
+
+  // step towards taken (up) or not-taken (down), saturating at the ends
+  void Update(UINT32 i, bool taken){
+    UINT8 *b = &storage.Ptr()[i >> PACK_SHIFT];
+    UINT32 s = Shift(i);
+    UINT32 v = (*b >> s) & FIELD_MASK;
+    UINT32 up = (UINT32) taken & (UINT32)(v < MAX);
+    UINT32 down = (UINT32) !taken & (UINT32)(v > 0);
+    *b = (UINT8)(*b + ((up - down) << s));
+  }
+};
+
+#endif
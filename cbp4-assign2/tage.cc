@@ -0,0 +1,417 @@
+#include "tage.h"
+#include <string.h>
+#include <math.h>
+
+/////////////////////////////////////////////////////////////
+// TAGE-SC-L
+/////////////////////////////////////////////////////////////
+
+// GEHL history lengths of the statistical corrector
+static const UINT32 scLengths[SC_NUM_TABLES] = { 4, 8, 12, 17, 27, 40 };
+
+static inline void CtrUpdate(INT8 &ctr, bool taken, int bits)
+{
+	int max = (1 << (bits - 1)) - 1;
+	int min = -(1 << (bits - 1));
+	if (taken) {
+		if (ctr < max) ctr++;
+	} else {
+		if (ctr > min) ctr--;
+	}
+}
+
+// XOR-folds h into n bits
+static inline UINT32 Fold(UINT64 h, UINT32 n)
+{
+	UINT32 r = 0;
+	while (h) {
+		r ^= h & ((1u << n) - 1);
+		h >>= n;
+	}
+	return r;
+}
+
+PREDICTOR_TAGE_SC_L::PREDICTOR_TAGE_SC_L()
+{
+	// geometric history lengths, longer tags for longer histories
+	histLength[0] = 0;
+	tagBits[0] = 0;
+	for (int i = 1; i <= TAGE_NUM_TABLES; i++) {
+		double ratio = pow((double) TAGE_MAX_HIST / TAGE_MIN_HIST,
+				   (double) (i - 1) / (TAGE_NUM_TABLES - 1));
+		histLength[i] = (UINT32) (TAGE_MIN_HIST * ratio + 0.5);
+		tagBits[i] = 8 + (4 * (i - 1)) / (TAGE_NUM_TABLES - 1);
+
+		indexFold[i].Init(histLength[i], TAGE_LOG_ENTRIES);
+		tagFold0[i].Init(histLength[i], tagBits[i]);
+		tagFold1[i].Init(histLength[i], tagBits[i] - 1);
+	}
+
+	bimodal.Fill(1);
+	memset(table, 0, sizeof(table));
+	pathHist = 0;
+	useAltOnNA = 0;
+	branchCount = 0;
+	seed = 0x2545f491;
+
+	memset(loopTable, 0, sizeof(loopTable));
+	withLoop = -1;
+
+	memset(scBias, 0, sizeof(scBias));
+	memset(scGehl, 0, sizeof(scGehl));
+	for (int k = 0; k < SC_NUM_TABLES; k++)
+		scHistLength[k] = scLengths[k];
+	scThreshold = 35;
+	scThresholdCtr = 0;
+}
+
+UINT32 PREDICTOR_TAGE_SC_L::Random()
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+// path history hash, different per bank (Seznec's F function)
+UINT32 PREDICTOR_TAGE_SC_L::PathHash(UINT32 path, UINT32 size, UINT32 bank)
+{
+	UINT32 mask = (1 << TAGE_LOG_ENTRIES) - 1;
+	UINT32 rot = bank % TAGE_LOG_ENTRIES;
+	UINT32 A = path & ((1 << size) - 1);
+	UINT32 A1 = A & mask;
+	UINT32 A2 = A >> TAGE_LOG_ENTRIES;
+
+	if (rot) A2 = ((A2 << rot) & mask) + (A2 >> (TAGE_LOG_ENTRIES - rot));
+	A = A1 ^ A2;
+	if (rot) A = ((A << rot) & mask) + (A >> (TAGE_LOG_ENTRIES - rot));
+	return A;
+}
+
+/////////////////////////////////////////////////////////////
+// loop predictor
+/////////////////////////////////////////////////////////////
+
+bool PREDICTOR_TAGE_SC_L::LoopPredict(UINT32 PC)
+{
+	UINT32 idx = LoopIndex(PC);
+	UINT16 tag = LoopTag(PC);
+
+	loopHit = -1;
+	loopValid = false;
+	for (int w = 0; w < LOOP_WAYS; w++) {
+		LOOP_ENTRY *e = &loopTable[idx + w];
+		if (e->tag == tag) {
+			loopHit = idx + w;
+			loopValid = (e->conf == LOOP_CONF_MAX) || (e->conf * e->numIter > 128);
+			if (e->currentIter + 1 == e->numIter)
+				return !e->dir;
+			return e->dir;
+		}
+	}
+	return false;
+}
+
+void PREDICTOR_TAGE_SC_L::LoopUpdate(UINT32 PC, bool taken, bool alloc)
+{
+	if (loopHit >= 0) {
+		LOOP_ENTRY *e = &loopTable[loopHit];
+
+		if (loopValid) {
+			if (taken != loopPred) {
+				// the trip count changed, free the entry
+				e->numIter = 0;
+				e->age = 0;
+				e->conf = 0;
+				e->currentIter = 0;
+				return;
+			} else if (loopPred != tagePred) {
+				if (e->age < 7) e->age++;
+			}
+		}
+
+		e->currentIter = (e->currentIter + 1) & 0x3ff;
+		if (e->currentIter > e->numIter) {
+			e->conf = 0;
+			e->numIter = 0;
+		}
+
+		if (taken != e->dir) {
+			if (e->currentIter == e->numIter) {
+				if (e->conf < LOOP_CONF_MAX) e->conf++;
+				// one or two iterations are left to TAGE
+				if (e->numIter < 3) {
+					e->dir = taken;
+					e->numIter = 0;
+					e->age = 0;
+					e->conf = 0;
+				}
+			} else if (e->numIter == 0) {
+				// first complete pass, remember the trip count
+				e->conf = 0;
+				e->numIter = e->currentIter;
+			} else {
+				e->numIter = 0;
+				e->conf = 0;
+			}
+			e->currentIter = 0;
+		}
+	} else if (alloc) {
+		LOOP_ENTRY *e = &loopTable[LoopIndex(PC) + (Random() & (LOOP_WAYS - 1))];
+
+		if (e->age == 0) {
+			// the mispredicted outcome is taken to be the loop exit
+			e->dir = !taken;
+			e->tag = LoopTag(PC);
+			e->numIter = 0;
+			e->age = 7;
+			e->conf = 0;
+			e->currentIter = 0;
+		} else {
+			e->age--;
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////
+// prediction
+/////////////////////////////////////////////////////////////
+
+bool PREDICTOR_TAGE_SC_L::GetPrediction(UINT32 PC)
+{
+	UINT32 mask = (1 << TAGE_LOG_ENTRIES) - 1;
+
+	// TAGE lookup
+	for (int i = 1; i <= TAGE_NUM_TABLES; i++) {
+		UINT32 shift = abs(TAGE_LOG_ENTRIES - i) + 1;
+		UINT32 pathLen = histLength[i] < TAGE_PATH_BITS ? histLength[i] : TAGE_PATH_BITS;
+
+		gIndex[i] = (PC ^ (PC >> shift) ^ indexFold[i].Value() ^ PathHash(pathHist, pathLen, i)) & mask;
+		gTag[i] = (PC ^ tagFold0[i].Value() ^ (tagFold1[i].Value() << 1)) & ((1 << tagBits[i]) - 1);
+	}
+
+	provider = 0;
+	altProvider = 0;
+	for (int i = TAGE_NUM_TABLES; i > 0; i--) {
+		if (table[i][gIndex[i]].tag == gTag[i]) {
+			provider = i;
+			break;
+		}
+	}
+	for (int i = provider - 1; i > 0; i--) {
+		if (table[i][gIndex[i]].tag == gTag[i]) {
+			altProvider = i;
+			break;
+		}
+	}
+
+	if (altProvider > 0)
+		altPred = table[altProvider][gIndex[altProvider]].ctr >= 0;
+	else
+		altPred = bimodal.IsTaken(BimodalIndex(PC));
+
+	if (provider > 0) {
+		int ctr = table[provider][gIndex[provider]].ctr;
+		int strength = abs(2 * ctr + 1);
+
+		providerPred = ctr >= 0;
+		providerWeak = (strength == 1);
+		tagePred = (providerWeak && useAltOnNA >= 0) ? altPred : providerPred;
+		tageConf = (strength == 1) ? 0 : (strength == 3) ? 1 : 2;
+	} else {
+		UINT32 ctr = bimodal.Get(BimodalIndex(PC));
+
+		providerPred = altPred;
+		providerWeak = false;
+		tagePred = altPred;
+		tageConf = (ctr == 0 || ctr == 3) ? 1 : 0;
+	}
+
+	// loop predictor
+	loopPred = LoopPredict(PC);
+	preScPred = (loopValid && withLoop >= 0) ? loopPred : tagePred;
+
+	// statistical corrector
+	scBiasIndex = ((PC << 3) ^ (tageConf << 1) ^ (UINT32) preScPred) & ((1 << (SC_LOG_ENTRIES + 2)) - 1);
+	scSum = 2 * scBias[scBiasIndex] + 1;
+	for (int k = 0; k < SC_NUM_TABLES; k++) {
+		UINT32 h = Fold(ghist.Recent(scHistLength[k]), SC_LOG_ENTRIES);
+		scIndex[k] = (PC ^ (PC >> (SC_LOG_ENTRIES - k)) ^ h) & ((1 << SC_LOG_ENTRIES) - 1);
+		scSum += 2 * scGehl[k][scIndex[k]] + 1;
+	}
+	scPred = scSum >= 0;
+
+	finalPred = preScPred;
+	if (scPred != preScPred) {
+		// a confident TAGE prediction is only reverted by a clear majority
+		if (tageConf < 2 || abs(scSum) >= scThreshold / 2)
+			finalPred = scPred;
+	}
+
+	return finalPred;
+}
+
+/////////////////////////////////////////////////////////////
+// update
+/////////////////////////////////////////////////////////////
+
+void PREDICTOR_TAGE_SC_L::ScUpdate(bool taken)
+{
+	if (scPred != preScPred) {
+		// O-GEHL style threshold adaptation
+		if (scPred != taken) {
+			if (++scThresholdCtr >= 63) {
+				scThreshold++;
+				scThresholdCtr = 0;
+			}
+		} else if (abs(scSum) < scThreshold) {
+			if (--scThresholdCtr <= -64) {
+				scThreshold--;
+				scThresholdCtr = 0;
+			}
+		}
+	}
+
+	if (scPred != taken || abs(scSum) < scThreshold) {
+		CtrUpdate(scBias[scBiasIndex], taken, SC_CTR_BITS);
+		for (int k = 0; k < SC_NUM_TABLES; k++)
+			CtrUpdate(scGehl[k][scIndex[k]], taken, SC_CTR_BITS);
+	}
+}
+
+void PREDICTOR_TAGE_SC_L::TageUpdate(UINT32 PC, bool taken)
+{
+	bool alloc = (tagePred != taken) && (provider < TAGE_NUM_TABLES);
+
+	if (provider > 0 && providerWeak) {
+		// a fresh entry that was right needs no company
+		if (providerPred == taken) alloc = false;
+
+		if (providerPred != altPred) {
+			if (altPred == taken) {
+				if (useAltOnNA < 7) useAltOnNA++;
+			} else {
+				if (useAltOnNA > -8) useAltOnNA--;
+			}
+		}
+	}
+
+	// allocate one entry in a longer-history table, starting one or two
+	// tables above the provider
+	if (alloc) {
+		int start = provider + 1 + (Random() & 1);
+		bool done = false;
+
+		if (start > TAGE_NUM_TABLES) start = provider + 1;
+		for (int i = start; i <= TAGE_NUM_TABLES; i++) {
+			TAGE_ENTRY *e = &table[i][gIndex[i]];
+			if (e->u == 0) {
+				e->tag = gTag[i];
+				e->ctr = taken ? 0 : -1;
+				done = true;
+				break;
+			}
+		}
+		if (!done) {
+			for (int i = start; i <= TAGE_NUM_TABLES; i++) {
+				TAGE_ENTRY *e = &table[i][gIndex[i]];
+				if (e->u > 0) e->u--;
+			}
+		}
+	}
+
+	// counters
+	if (provider > 0) {
+		TAGE_ENTRY *e = &table[provider][gIndex[provider]];
+
+		CtrUpdate(e->ctr, taken, 3);
+		if (e->u == 0) {
+			if (altProvider > 0)
+				CtrUpdate(table[altProvider][gIndex[altProvider]].ctr, taken, 3);
+			else
+				bimodal.Update(BimodalIndex(PC), taken);
+		}
+
+		// usefulness: the provider was right where the alternate was not
+		if (providerPred != altPred) {
+			if (providerPred == taken) {
+				if (e->u < 3) e->u++;
+			} else {
+				if (e->u > 0) e->u--;
+			}
+		}
+	} else {
+		bimodal.Update(BimodalIndex(PC), taken);
+	}
+
+	// periodic usefulness decay
+	if ((++branchCount & (TAGE_U_RESET_PERIOD - 1)) == 0) {
+		for (int i = 1; i <= TAGE_NUM_TABLES; i++)
+			for (int j = 0; j < (1 << TAGE_LOG_ENTRIES); j++)
+				table[i][j].u >>= 1;
+	}
+}
+
+void PREDICTOR_TAGE_SC_L::HistoryUpdate(UINT32 PC, bool taken)
+{
+	ghist.Push(taken);
+	pathHist = ((pathHist << 1) ^ ((PC ^ (PC >> 2)) & 1)) & ((1 << TAGE_PATH_BITS) - 1);
+
+	for (int i = 1; i <= TAGE_NUM_TABLES; i++) {
+		indexFold[i].Update(ghist);
+		tagFold0[i].Update(ghist);
+		tagFold1[i].Update(ghist);
+	}
+}
+
+void PREDICTOR_TAGE_SC_L::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget)
+{
+	ScUpdate(resolveDir);
+
+	if (loopValid && loopPred != tagePred) {
+		if (loopPred == resolveDir) {
+			if (withLoop < 63) withLoop++;
+		} else {
+			if (withLoop > -64) withLoop--;
+		}
+	}
+	LoopUpdate(PC, resolveDir, (tagePred != resolveDir) && (Random() & 3) == 0);
+
+	TageUpdate(PC, resolveDir);
+	HistoryUpdate(PC, resolveDir);
+}
+
+void PREDICTOR_TAGE_SC_L::Checkpoint(CHECKPOINT &cp)
+{
+	bimodal.Checkpoint(cp);
+	cp.Value(table);
+	cp.Value(ghist);
+	cp.Value(pathHist);
+	cp.Value(indexFold);
+	cp.Value(tagFold0);
+	cp.Value(tagFold1);
+	cp.Value(useAltOnNA);
+	cp.Value(branchCount);
+	cp.Value(seed);
+
+	cp.Value(loopTable);
+	cp.Value(withLoop);
+
+	cp.Value(scBias);
+	cp.Value(scGehl);
+	cp.Value(scThreshold);
+	cp.Value(scThresholdCtr);
+}
+
+UINT64 PREDICTOR_TAGE_SC_L::StorageBits()
+{
+	UINT64 bits = bimodal.StorageBits();
+
+	for (int i = 1; i <= TAGE_NUM_TABLES; i++)
+		bits += (UINT64) (1 << TAGE_LOG_ENTRIES) * (3 + 2 + tagBits[i]);
+	bits += TAGE_MAX_HIST + TAGE_PATH_BITS + 4;				// histories, useAltOnNA
+	bits += (1 << LOOP_LOG_ENTRIES) * (10 + 10 + 10 + 4 + 3 + 1) + 7;	// loop table, withLoop
+	bits += (UINT64) ((1 << (SC_LOG_ENTRIES + 2)) + SC_NUM_TABLES * (1 << SC_LOG_ENTRIES)) * SC_CTR_BITS;
+	bits += 8 + 7;								// threshold and its counter
+	return bits;
+}
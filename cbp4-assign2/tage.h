@@ -0,0 +1,136 @@
+#ifndef _TAGE_H_
+#define _TAGE_H_
+
+#include "predictor.h"
+
+/////////////////////////////////////////////////////////////
+// TAGE-SC-L
+/////////////////////////////////////////////////////////////
+
+// A TAGE predictor (bimodal base plus tagged tables indexed with
+// geometrically increasing global history lengths), a loop predictor and
+// a statistical corrector (bias table plus GEHL tables) that can revert
+// TAGE predictions that are statistically biased the other way.
+//
+// The storage budget is chosen at compile time with TAGE_BUDGET_KB, which
+// sets how many entries each tagged table gets, e.g.
+//
+//   make CXXFLAGS="-O3 -DTAGE_BUDGET_KB=32"
+
+#ifndef TAGE_BUDGET_KB
+#define TAGE_BUDGET_KB		64
+#endif
+
+#if TAGE_BUDGET_KB >= 256
+#define TAGE_LOG_ENTRIES	13
+#elif TAGE_BUDGET_KB >= 128
+#define TAGE_LOG_ENTRIES	12
+#elif TAGE_BUDGET_KB >= 64
+#define TAGE_LOG_ENTRIES	11
+#elif TAGE_BUDGET_KB >= 32
+#define TAGE_LOG_ENTRIES	10
+#elif TAGE_BUDGET_KB >= 16
+#define TAGE_LOG_ENTRIES	9
+#else
+#define TAGE_LOG_ENTRIES	8
+#endif
+
+#define TAGE_NUM_TABLES		12	// tagged tables, 1..TAGE_NUM_TABLES
+#define TAGE_MIN_HIST		4
+#define TAGE_MAX_HIST		640
+#define TAGE_LOG_BIMODAL	(TAGE_LOG_ENTRIES + 2)
+#define TAGE_PATH_BITS		16
+#define TAGE_U_RESET_PERIOD	(1 << 18)	// branches between usefulness decays
+
+#define LOOP_LOG_ENTRIES	6		// 4-way, 16 sets
+#define LOOP_WAYS		4
+#define LOOP_CONF_MAX		15
+
+#define SC_NUM_TABLES		6		// GEHL tables
+#define SC_LOG_ENTRIES		(TAGE_LOG_ENTRIES - 1)
+#define SC_CTR_BITS		6
+
+class PREDICTOR_TAGE_SC_L : public PREDICTOR{
+ private:
+  struct TAGE_ENTRY{
+    INT8   ctr;          // 3-bit signed, taken when >= 0
+    UINT8  u;            // 2-bit usefulness
+    UINT16 tag;
+  };
+
+  struct LOOP_ENTRY{
+    UINT16 numIter;      // trip count, exit iteration included
+    UINT16 currentIter;
+    UINT16 tag;
+    UINT8  conf;
+    UINT8  age;
+    bool   dir;          // direction of the loop body
+  };
+
+  // TAGE
+  SatCounterTable<2, 1 << TAGE_LOG_BIMODAL> bimodal;
+  TAGE_ENTRY     table[TAGE_NUM_TABLES + 1][1 << TAGE_LOG_ENTRIES];
+  UINT32         histLength[TAGE_NUM_TABLES + 1];
+  UINT32         tagBits[TAGE_NUM_TABLES + 1];
+
+  HistoryRegister<TAGE_MAX_HIST> ghist;
+  UINT32         pathHist;
+  FoldedHistory  indexFold[TAGE_NUM_TABLES + 1];
+  FoldedHistory  tagFold0[TAGE_NUM_TABLES + 1];
+  FoldedHistory  tagFold1[TAGE_NUM_TABLES + 1];
+
+  INT32          useAltOnNA;     // >= 0: trust the alternate over a weak new entry
+  UINT32         branchCount;
+  UINT32         seed;
+
+  // loop predictor
+  LOOP_ENTRY     loopTable[1 << LOOP_LOG_ENTRIES];
+  INT32          withLoop;       // >= 0: loop predictor overrides when confident
+
+  // statistical corrector
+  INT8           scBias[1 << (SC_LOG_ENTRIES + 2)];
+  INT8           scGehl[SC_NUM_TABLES][1 << SC_LOG_ENTRIES];
+  UINT32         scHistLength[SC_NUM_TABLES];
+  INT32          scThreshold;
+  INT32          scThresholdCtr;
+
+  // state computed by GetPrediction and consumed by UpdatePredictor
+  UINT32 gIndex[TAGE_NUM_TABLES + 1];
+  UINT32 gTag[TAGE_NUM_TABLES + 1];
+  int    provider, altProvider;
+  bool   providerPred, altPred, tagePred;
+  bool   providerWeak;
+  int    tageConf;               // 0 weak, 1 medium, 2 strong provider counter
+  int    loopHit;
+  bool   loopPred, loopValid;
+  bool   preScPred;              // TAGE or loop, before the corrector
+  UINT32 scIndex[SC_NUM_TABLES];
+  UINT32 scBiasIndex;
+  INT32  scSum;
+  bool   scPred;
+  bool   finalPred;
+
+  UINT32 Random();
+  UINT32 PathHash(UINT32 path, UINT32 size, UINT32 bank);
+  UINT32 BimodalIndex(UINT32 PC){ return PC & ((1 << TAGE_LOG_BIMODAL) - 1); }
+
+  bool   LoopPredict(UINT32 PC);
+  void   LoopUpdate(UINT32 PC, bool taken, bool alloc);
+  UINT32 LoopIndex(UINT32 PC){ return (PC & ((1 << (LOOP_LOG_ENTRIES - 2)) - 1)) << 2; }
+  UINT16 LoopTag(UINT32 PC){ return (PC >> (LOOP_LOG_ENTRIES - 2)) & 0x3ff; }
+
+  void   TageUpdate(UINT32 PC, bool taken);
+  void   ScUpdate(bool taken);
+  void   HistoryUpdate(UINT32 PC, bool taken);
+
+ public:
+  PREDICTOR_TAGE_SC_L();
+
+  bool GetPrediction(UINT32 PC);
+  void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+  void Checkpoint(CHECKPOINT &cp);
+
+  UINT64 StorageBits();
+};
+
+#endif
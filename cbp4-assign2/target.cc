@@ -0,0 +1,420 @@
+#include "target.h"
+#include <string.h>
+#include <math.h>
+
+const char *targetClassName[TCLASS_MAX] = { "CALL_DIRECT", "INDIRECT_BR_CALL", "RET", "BRANCH_UNCOND" };
+
+/////////////////////////////////////////////////////////////
+// BTB
+/////////////////////////////////////////////////////////////
+
+TARGET_BTB::TARGET_BTB(UINT32 logNumSets, UINT32 numWays)
+{
+	logSets = logNumSets;
+	ways = numWays;
+
+	BTB_ENTRY empty = { 0, 0, 0, 0 };
+	entries.assign((size_t) ways << logSets, empty);
+	for (size_t i = 0; i < entries.size(); i++)
+		entries[i].age = i % ways;
+}
+
+// makes way the most recently used one of its set
+void TARGET_BTB::Touch(BTB_ENTRY *set, UINT32 way)
+{
+	for (UINT32 w = 0; w < ways; w++) {
+		if (set[w].age < set[way].age)
+			set[w].age++;
+	}
+	set[way].age = 0;
+}
+
+bool TARGET_BTB::Lookup(UINT32 PC, UINT32 *target)
+{
+	BTB_ENTRY *set = &entries[(size_t) Set(PC) * ways];
+	UINT16 tag = Tag(PC);
+
+	for (UINT32 w = 0; w < ways; w++) {
+		if (set[w].valid && set[w].tag == tag) {
+			*target = set[w].target;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TARGET_BTB::Update(UINT32 PC, UINT32 target)
+{
+	BTB_ENTRY *set = &entries[(size_t) Set(PC) * ways];
+	UINT16 tag = Tag(PC);
+	UINT32 victim = 0;
+
+	for (UINT32 w = 0; w < ways; w++) {
+		if (set[w].valid && set[w].tag == tag) {
+			set[w].target = target;
+			Touch(set, w);
+			return;
+		}
+		if (set[w].age > set[victim].age)
+			victim = w;
+	}
+
+	set[victim].valid = 1;
+	set[victim].tag = tag;
+	set[victim].target = target;
+	Touch(set, victim);
+}
+
+void TARGET_BTB::Checkpoint(CHECKPOINT &cp)
+{
+	cp.Vector(entries);
+}
+
+UINT64 TARGET_BTB::StorageBits()
+{
+	UINT32 ageBits = 0;
+	while ((1u << ageBits) < ways)
+		ageBits++;
+	return (UINT64) entries.size() * (32 + BTB_TAG_BITS + 1 + ageBits);
+}
+
+/////////////////////////////////////////////////////////////
+// return address stack
+/////////////////////////////////////////////////////////////
+
+TARGET_RAS::TARGET_RAS(UINT32 depth)
+{
+	stack.assign(depth, 0);
+	top = 0;
+	count = 0;
+	memset(callLength, 0, sizeof(callLength));
+	lastLength = 0;
+}
+
+void TARGET_RAS::Push(UINT32 callPC)
+{
+	top = (top + 1) % stack.size();
+	stack[top] = callPC;
+	if (count < stack.size())
+		count++;
+}
+
+bool TARGET_RAS::Predict(UINT32 *target)
+{
+	if (count == 0)
+		return false;
+
+	UINT32 callPC = stack[top];
+	UINT8 length = callLength[callPC & 63];
+	*target = callPC + (length ? length : lastLength);
+	return true;
+}
+
+// pops the call this return belongs to and learns its length
+void TARGET_RAS::Pop(UINT32 target)
+{
+	if (count == 0)
+		return;
+
+	UINT32 callPC = stack[top];
+	UINT32 length = target - callPC;
+	if (length > 0 && length < 16) {
+		callLength[callPC & 63] = length;
+		lastLength = length;
+	}
+
+	top = (top == 0) ? stack.size() - 1 : top - 1;
+	count--;
+}
+
+void TARGET_RAS::Checkpoint(CHECKPOINT &cp)
+{
+	cp.Vector(stack);
+	cp.Value(top);
+	cp.Value(count);
+	cp.Value(callLength);
+	cp.Value(lastLength);
+}
+
+UINT64 TARGET_RAS::StorageBits()
+{
+	UINT32 ptrBits = 0;
+	while ((1u << ptrBits) < stack.size())
+		ptrBits++;
+	return (UINT64) stack.size() * 32 + 2 * (ptrBits + 1) + (64 + 1) * 4;
+}
+
+/////////////////////////////////////////////////////////////
+// ITTAGE
+/////////////////////////////////////////////////////////////
+
+TARGET_ITTAGE::TARGET_ITTAGE(UINT32 logEntriesPerTable)
+{
+	logEntries = logEntriesPerTable;
+
+	ITTAGE_ENTRY empty = { 0, 0, 0, 0 };
+	histLength[0] = 0;
+	for (int i = 1; i <= ITTAGE_TABLES; i++) {
+		double ratio = pow((double) ITTAGE_MAX_HIST / ITTAGE_MIN_HIST,
+				   (double) (i - 1) / (ITTAGE_TABLES - 1));
+		histLength[i] = (UINT32) (ITTAGE_MIN_HIST * ratio + 0.5);
+
+		table[i].assign(1 << logEntries, empty);
+		indexFold[i].Init(histLength[i], logEntries);
+		tagFold0[i].Init(histLength[i], ITTAGE_TAG_BITS);
+		tagFold1[i].Init(histLength[i], ITTAGE_TAG_BITS - 1);
+	}
+
+	pathHist = 0;
+	updateCount = 0;
+	seed = 0x9e3779b9;
+	provider = altProvider = 0;
+	predTarget = altTarget = 0;
+}
+
+UINT32 TARGET_ITTAGE::Random()
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+UINT32 TARGET_ITTAGE::Predict(UINT32 PC, UINT32 baseTarget)
+{
+	UINT32 mask = (1 << logEntries) - 1;
+
+	provider = altProvider = 0;
+	for (int i = 1; i <= ITTAGE_TABLES; i++) {
+		gIndex[i] = (PC ^ (PC >> (logEntries - (i % 4))) ^ indexFold[i].Value()
+			     ^ (pathHist >> i)) & mask;
+		gTag[i] = (PC ^ tagFold0[i].Value() ^ (tagFold1[i].Value() << 1))
+			& ((1 << ITTAGE_TAG_BITS) - 1);
+	}
+	for (int i = ITTAGE_TABLES; i >= 1; i--) {
+		if (table[i][gIndex[i]].tag == gTag[i]) {
+			if (provider == 0)
+				provider = i;
+			else {
+				altProvider = i;
+				break;
+			}
+		}
+	}
+
+	altTarget = altProvider ? table[altProvider][gIndex[altProvider]].target : baseTarget;
+	if (provider == 0)
+		predTarget = baseTarget;
+	else if (table[provider][gIndex[provider]].ctr == 0)
+		predTarget = altTarget;		// newly allocated, not trusted yet
+	else
+		predTarget = table[provider][gIndex[provider]].target;
+	return predTarget;
+}
+
+void TARGET_ITTAGE::Update(UINT32 PC, UINT32 target)
+{
+	if (provider) {
+		ITTAGE_ENTRY &e = table[provider][gIndex[provider]];
+
+		if (e.target == target) {
+			if (e.ctr < 3) e.ctr++;
+			if (altTarget != target) e.u = 1;
+		} else if (e.ctr > 0) {
+			e.ctr--;
+		} else {
+			e.target = target;
+		}
+	}
+
+	// allocate one entry in a longer-history table on a misprediction
+	if (predTarget != target && provider < ITTAGE_TABLES) {
+		int start = provider + 1 + (Random() & 1);
+		bool done = false;
+		for (int i = start; i <= ITTAGE_TABLES && !done; i++) {
+			ITTAGE_ENTRY &e = table[i][gIndex[i]];
+			if (e.u == 0) {
+				e.tag = gTag[i];
+				e.target = target;
+				e.ctr = 0;
+				done = true;
+			}
+		}
+		if (!done) {
+			for (int i = provider + 1; i <= ITTAGE_TABLES; i++)
+				table[i][gIndex[i]].u = 0;
+		}
+	}
+
+	if (++updateCount % ITTAGE_U_RESET_PERIOD == 0) {
+		for (int i = 1; i <= ITTAGE_TABLES; i++)
+			for (size_t j = 0; j < table[i].size(); j++)
+				table[i][j].u = 0;
+	}
+}
+
+void TARGET_ITTAGE::PushHistory(bool bit)
+{
+	ghist.Push(bit);
+	for (int i = 1; i <= ITTAGE_TABLES; i++) {
+		indexFold[i].Update(ghist);
+		tagFold0[i].Update(ghist);
+		tagFold1[i].Update(ghist);
+	}
+}
+
+// conditional branches add their outcome, indirect branches two bits of
+// their target, other transfers their taken bit
+void TARGET_ITTAGE::UpdateHistory(UINT32 PC, UINT32 opType, bool taken, UINT32 target)
+{
+	if (opType == OPTYPE_INDIRECT_BR_CALL) {
+		PushHistory((target >> 2) & 1);
+		PushHistory((target >> 3) & 1);
+	} else {
+		PushHistory(taken);
+	}
+	pathHist = ((pathHist << 1) | ((PC >> 2) & 1)) & 0xffff;
+}
+
+void TARGET_ITTAGE::Checkpoint(CHECKPOINT &cp)
+{
+	for (int i = 1; i <= ITTAGE_TABLES; i++)
+		cp.Vector(table[i]);
+	cp.Value(ghist);
+	cp.Value(pathHist);
+	cp.Value(indexFold);
+	cp.Value(tagFold0);
+	cp.Value(tagFold1);
+	cp.Value(updateCount);
+	cp.Value(seed);
+}
+
+UINT64 TARGET_ITTAGE::StorageBits()
+{
+	UINT64 bits = (UINT64) ITTAGE_TABLES * (1 << logEntries) * (32 + ITTAGE_TAG_BITS + 2 + 1);
+	return bits + ITTAGE_MAX_HIST + 16;
+}
+
+/////////////////////////////////////////////////////////////
+// front end: BTB, optional RAS and ITTAGE
+/////////////////////////////////////////////////////////////
+
+TARGET_PREDICTOR::TARGET_PREDICTOR(UINT32 btbLogSets, UINT32 btbWays, UINT32 rasDepth, UINT32 ittageLogEntries)
+	: btb(btbLogSets, btbWays)
+{
+	ras = rasDepth ? new TARGET_RAS(rasDepth) : NULL;
+	ittage = ittageLogEntries ? new TARGET_ITTAGE(ittageLogEntries) : NULL;
+}
+
+TARGET_PREDICTOR::~TARGET_PREDICTOR()
+{
+	delete ras;
+	delete ittage;
+}
+
+UINT32 TARGET_PREDICTOR::PredictTarget(UINT32 PC, UINT32 opType)
+{
+	UINT32 target = 0;
+
+	if (opType == OPTYPE_RET && ras && ras->Predict(&target))
+		return target;
+
+	btb.Lookup(PC, &target);
+	if (opType == OPTYPE_INDIRECT_BR_CALL && ittage)
+		target = ittage->Predict(PC, target);
+	return target;
+}
+
+void TARGET_PREDICTOR::UpdateTarget(UINT32 PC, UINT32 opType, bool taken, UINT32 target)
+{
+	if (GetTargetClass(opType) != TCLASS_MAX) {
+		if (opType == OPTYPE_INDIRECT_BR_CALL && ittage)
+			ittage->Update(PC, target);
+		if (opType != OPTYPE_RET || !ras)
+			btb.Update(PC, target);
+
+		if (ras && opType == OPTYPE_RET)
+			ras->Pop(target);
+		if (ras && (opType == OPTYPE_CALL_DIRECT || opType == OPTYPE_INDIRECT_BR_CALL))
+			ras->Push(PC);
+	}
+
+	if (ittage)
+		ittage->UpdateHistory(PC, opType, taken, target);
+}
+
+void TARGET_PREDICTOR::Checkpoint(CHECKPOINT &cp)
+{
+	btb.Checkpoint(cp);
+	if (ras) ras->Checkpoint(cp);
+	if (ittage) ittage->Checkpoint(cp);
+}
+
+UINT64 TARGET_PREDICTOR::StorageBits()
+{
+	UINT64 bits = btb.StorageBits();
+
+	if (ras) bits += ras->StorageBits();
+	if (ittage) bits += ittage->StorageBits();
+	return bits;
+}
+
+/////////////////////////////////////////////////////////////
+// registry
+/////////////////////////////////////////////////////////////
+
+static TARGET_PREDICTOR *Create(UINT32 btbLogSets, UINT32 btbWays, UINT32 rasDepth, UINT32 ittageLogEntries)
+{
+	if (btbLogSets > 20 || btbWays < 1 || btbWays > 64 || rasDepth > 1024 || ittageLogEntries > 20)
+		return NULL;
+	return new TARGET_PREDICTOR(btbLogSets, btbWays, rasDepth, ittageLogEntries);
+}
+
+static TARGET_PREDICTOR *CreateBtb(const std::vector<UINT32> &args)
+{
+	return Create(args[0], args[1], 0, 0);
+}
+
+static TARGET_PREDICTOR *CreateRas(const std::vector<UINT32> &args)
+{
+	if (args[0] < 1) return NULL;
+	return Create(args[1], args[2], args[0], 0);
+}
+
+static TARGET_PREDICTOR *CreateIttage(const std::vector<UINT32> &args)
+{
+	if (args[0] < 4) return NULL;
+	return Create(args[2], args[3], args[1], args[0]);
+}
+
+static struct {
+	const char  *name;
+	const char  *usage;
+	UINT32       numArgs;
+	UINT32       defaults[4];
+	TARGET_PREDICTOR *(*factory)(const std::vector<UINT32> &args);
+} targetRegistry[] = {
+	{ "btb",    "btb[:<log2 sets>[:<ways>]]",                                               2, { btb_log_sets, btb_ways }, CreateBtb },
+	{ "ras",    "ras[:<depth>[:<btb log2 sets>[:<btb ways>]]]",                             3, { ras_depth, btb_log_sets, btb_ways }, CreateRas },
+	{ "ittage", "ittage[:<log2 entries>[:<ras depth>[:<btb log2 sets>[:<btb ways>]]]]",   4, { ittage_log_entries, ras_depth, btb_log_sets, btb_ways }, CreateIttage },
+};
+
+TARGET_PREDICTOR *CreateTargetPredictor(const char *spec)
+{
+	for (size_t i = 0; i < sizeof(targetRegistry) / sizeof(targetRegistry[0]); i++) {
+		if (!SpecNameIs(spec, targetRegistry[i].name))
+			continue;
+
+		std::vector<UINT32> args;
+		if (!ParseSpecArgs(spec, targetRegistry[i].numArgs, targetRegistry[i].defaults, args))
+			return NULL;
+		return targetRegistry[i].factory(args);
+	}
+	return NULL;
+}
+
+void PrintTargetPredictorUsage(FILE *out)
+{
+	for (size_t i = 0; i < sizeof(targetRegistry) / sizeof(targetRegistry[0]); i++)
+		fprintf(out, "  --target %s\n", targetRegistry[i].usage);
+}
@@ -0,0 +1,181 @@
+#ifndef _TARGET_H_
+#define _TARGET_H_
+
+#include "predictor.h"
+
+/////////////////////////////////////////////////////////////
+// branch target prediction
+/////////////////////////////////////////////////////////////
+
+// Target prediction for the unconditional control transfers of a trace:
+// direct calls and jumps, indirect branches/calls and returns. Every
+// configuration has a BTB; a return address stack and an ITTAGE indirect
+// predictor can be added on top of it. Conditional branches are not
+// target-predicted but still feed the ITTAGE history.
+
+// classes reported separately, in output order
+enum TargetClass{
+  TCLASS_CALL_DIRECT = 0,
+  TCLASS_INDIRECT,
+  TCLASS_RET,
+  TCLASS_UNCOND,
+  TCLASS_MAX
+};
+
+// TCLASS_MAX for records that are not target-predicted
+static inline int GetTargetClass(UINT32 opType)
+{
+  switch(opType){
+  case OPTYPE_CALL_DIRECT:      return TCLASS_CALL_DIRECT;
+  case OPTYPE_INDIRECT_BR_CALL: return TCLASS_INDIRECT;
+  case OPTYPE_RET:              return TCLASS_RET;
+  case OPTYPE_BRANCH_UNCOND:    return TCLASS_UNCOND;
+  default:                      return TCLASS_MAX;
+  }
+}
+
+extern const char *targetClassName[TCLASS_MAX];
+
+#define btb_log_sets		9
+#define btb_ways		4
+#define ras_depth		16
+#define ittage_log_entries	9
+
+#define BTB_TAG_BITS		16
+
+#define ITTAGE_TABLES		6
+#define ITTAGE_MIN_HIST		4
+#define ITTAGE_MAX_HIST		160
+#define ITTAGE_TAG_BITS		11
+#define ITTAGE_U_RESET_PERIOD	(1 << 16)
+
+/////////////////////////////////////////////////////////////
+
+// set-associative BTB with partial tags and LRU replacement
+class TARGET_BTB{
+ private:
+  struct BTB_ENTRY{
+    UINT32 target;
+    UINT16 tag;
+    UINT8  valid;
+    UINT8  age;          // 0 = most recently used
+  };
+
+  UINT32 logSets;
+  UINT32 ways;
+  std::vector<BTB_ENTRY> entries;
+
+  UINT32 Set(UINT32 PC){ return (PC ^ (PC >> logSets)) & ((1 << logSets) - 1); }
+  UINT16 Tag(UINT32 PC){ return (PC >> logSets) & ((1 << BTB_TAG_BITS) - 1); }
+  void   Touch(BTB_ENTRY *set, UINT32 way);
+
+ public:
+  TARGET_BTB(UINT32 logNumSets, UINT32 numWays);
+
+  bool   Lookup(UINT32 PC, UINT32 *target);
+  void   Update(UINT32 PC, UINT32 target);
+  void   Checkpoint(CHECKPOINT &cp);
+  UINT64 StorageBits();
+};
+
+/////////////////////////////////////////////////////////////
+
+// Return address stack. The trace does not give instruction lengths, so
+// the stack holds call PCs and the distance from a call to its return
+// address is learned per call site (and globally for unseen sites).
+class TARGET_RAS{
+ private:
+  std::vector<UINT32> stack;   // circular, overflow overwrites the oldest
+  UINT32 top;
+  UINT32 count;
+  UINT8  callLength[64];
+  UINT8  lastLength;
+
+ public:
+  TARGET_RAS(UINT32 depth);
+
+  void   Push(UINT32 callPC);
+  bool   Predict(UINT32 *target);
+  void   Pop(UINT32 target);
+  void   Checkpoint(CHECKPOINT &cp);
+  UINT64 StorageBits();
+};
+
+/////////////////////////////////////////////////////////////
+
+// ITTAGE: tagged tables indexed with geometric global history lengths,
+// each entry holding a full target and a confidence counter. Without a
+// hit the BTB target is used.
+class TARGET_ITTAGE{
+ private:
+  struct ITTAGE_ENTRY{
+    UINT32 target;
+    UINT16 tag;
+    UINT8  ctr;          // 2-bit confidence
+    UINT8  u;            // 1-bit usefulness
+  };
+
+  UINT32 logEntries;
+  std::vector<ITTAGE_ENTRY> table[ITTAGE_TABLES + 1];
+  UINT32 histLength[ITTAGE_TABLES + 1];
+
+  HistoryRegister<ITTAGE_MAX_HIST> ghist;
+  UINT32        pathHist;
+  FoldedHistory indexFold[ITTAGE_TABLES + 1];
+  FoldedHistory tagFold0[ITTAGE_TABLES + 1];
+  FoldedHistory tagFold1[ITTAGE_TABLES + 1];
+  UINT32        updateCount;
+  UINT32        seed;
+
+  // state computed by Predict and consumed by Update
+  UINT32 gIndex[ITTAGE_TABLES + 1];
+  UINT16 gTag[ITTAGE_TABLES + 1];
+  int    provider, altProvider;
+  UINT32 predTarget;
+  UINT32 altTarget;     // what it would have predicted without the provider
+
+  UINT32 Random();
+  void   PushHistory(bool bit);
+
+ public:
+  TARGET_ITTAGE(UINT32 logEntriesPerTable);
+
+  UINT32 Predict(UINT32 PC, UINT32 baseTarget);
+  void   Update(UINT32 PC, UINT32 target);
+  void   UpdateHistory(UINT32 PC, UINT32 opType, bool taken, UINT32 target);
+  void   Checkpoint(CHECKPOINT &cp);
+  UINT64 StorageBits();
+};
+
+/////////////////////////////////////////////////////////////
+
+// btb[:<log2 sets>[:<ways>]]
+// ras[:<depth>[:<btb log2 sets>[:<btb ways>]]]
+// ittage[:<log2 entries>[:<ras depth>[:<btb log2 sets>[:<btb ways>]]]]
+class TARGET_PREDICTOR{
+ private:
+  TARGET_BTB     btb;
+  TARGET_RAS    *ras;          // NULL when not configured
+  TARGET_ITTAGE *ittage;       // NULL when not configured
+
+ public:
+  TARGET_PREDICTOR(UINT32 btbLogSets, UINT32 btbWays, UINT32 rasDepth, UINT32 ittageLogEntries);
+  ~TARGET_PREDICTOR();
+
+  // predicted target of a control transfer of class GetTargetClass(opType)
+  UINT32 PredictTarget(UINT32 PC, UINT32 opType);
+
+  // called for every control transfer, conditional ones included, after
+  // PredictTarget for the target-predicted classes
+  void   UpdateTarget(UINT32 PC, UINT32 opType, bool taken, UINT32 target);
+
+  void   Checkpoint(CHECKPOINT &cp);
+  UINT64 StorageBits();
+};
+
+// Builds a target predictor from a spec as above; NULL if invalid.
+TARGET_PREDICTOR *CreateTargetPredictor(const char *spec);
+
+void PrintTargetPredictorUsage(FILE *out);
+
+#endif
@@ -12,46 +12,624 @@
 // IMPORTANT NOTE: Changing anything in here will violate the competition rules.
 
 #include <assert.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
 #include "tracer.h"
 
 /////////////////////////////////////////
 /////////////////////////////////////////
 
 CBP_TRACER::CBP_TRACER(char *traceFileName){
-  char  cmdString[1024];
-  
-  sprintf(cmdString,"gunzip -c %s", traceFileName);
+  UINT8  magic[2];
+  int    traceFd;
 
-  if ((traceFile = popen(cmdString, "r")) == NULL){
+  fileName=traceFileName;
+  fd=-1;
+  inBuf=NULL;
+  rawDeflate=false;
+  skipBytes=0;
+  streamDone=false;
+  mapBase=NULL;
+  mapSize=0;
+  buf=NULL;
+  bufPos=0;
+  bufEnd=0;
+  colMode=false;
+  branchOnly=false;
+  colChunk=0;
+  colChunkStart=0;
+  colChunkRecords=0;
+  eCount=0;
+  eNext=0;
+  regionStart=0;
+
+  if ((traceFd = open(traceFileName, O_RDONLY)) < 0){
    printf("Unable to open the trace file. Dying\n");
    exit(-1);
   }
 
+  // gzip traces are inflated in-process; anything else is taken to be an
+  // already-decompressed or columnar trace and mapped straight into memory
+  if (read(traceFd, magic, 2) == 2 && magic[0] == 0x1f && magic[1] == 0x8b){
+    fd = traceFd;
+    lseek(fd, 0, SEEK_SET);
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 15 + 16) != Z_OK){
+     printf("Unable to open the trace file. Dying\n");
+     exit(-1);
+    }
+    inBuf = new UINT8[CBP_TRACE_IN_SIZE];
+    buf = new UINT8[CBP_TRACE_BUF_SIZE];
+  }
+  else{
+    struct stat st;
+
+    if (fstat(traceFd, &st) < 0){
+     printf("Unable to open the trace file. Dying\n");
+     exit(-1);
+    }
+    mapSize = st.st_size;
+    if (mapSize > 0){
+      mapBase = (UINT8 *) mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, traceFd, 0);
+      if (mapBase == (UINT8 *) MAP_FAILED){
+       printf("Unable to map the trace file. Dying\n");
+       exit(-1);
+      }
+      madvise(mapBase, mapSize, MADV_SEQUENTIAL);
+    }
+    close(traceFd);
+
+    buf=mapBase;
+    bufEnd=mapSize;
+
+    if (mapSize >= sizeof(CBPC_FILE_HEADER) && memcmp(mapBase, CBPC_MAGIC, 8) == 0){
+      memcpy(&colHeader, mapBase, sizeof(colHeader));
+      if (colHeader.chunkRecords == 0 ||
+          colHeader.dirOffset + (UINT64) colHeader.numChunks * 8 > mapSize){
+       printf("Corrupt trace file. Dying\n");
+       exit(-1);
+      }
+      colMode = true;
+      bufEnd = 0;
+    }
+  }
+
   numInst=0;
   numCondBranch=0;
+  instLimit=~0ULL;
+  lastHeartBeat=0;
+  heartBeat=true;
+  interval=0;
+  nextSample=~0ULL;
+  lastSample=0;
+
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+CBP_TRACER::~CBP_TRACER(){
+  if (fd >= 0){
+    inflateEnd(&strm);
+    close(fd);
+    delete [] inBuf;
+    delete [] buf;
+  }
+  if (mapBase){
+    munmap(mapBase, mapSize);
+  }
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Moves the undecoded tail of the buffer to the front and inflates behind it.
+// Returns false once no further bytes can be had.
+
+bool  CBP_TRACER::FillBuffer(){
+  size_t left = bufEnd - bufPos;
+  size_t got;
+
+  if (fd < 0){
+    return false; // the mapping already holds the whole trace
+  }
+
+  memmove(buf, buf + bufPos, left);
+  bufPos=0;
+  bufEnd=left;
+
+  strm.next_out = buf + left;
+  strm.avail_out = CBP_TRACE_BUF_SIZE - left;
+
+  while (strm.avail_out > 0 && !streamDone){
+    if (strm.avail_in == 0){
+      ssize_t n = read(fd, inBuf, CBP_TRACE_IN_SIZE);
+      if (n <= 0){
+        streamDone = true; // end of file (or a truncated trace)
+        break;
+      }
+      strm.next_in = inBuf;
+      strm.avail_in = n;
+    }
+
+    // after a raw stream, step over its gzip trailer to the next member
+    if (skipBytes > 0){
+      UINT32 skip = (skipBytes < strm.avail_in) ? skipBytes : strm.avail_in;
+      strm.next_in += skip;
+      strm.avail_in -= skip;
+      if ((skipBytes -= skip) == 0){
+        inflateReset2(&strm, 15 + 16);
+        rawDeflate = false;
+      }
+      continue;
+    }
+
+    int ret = inflate(&strm, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END){
+      // concatenated gzip members decode as one trace
+      if (rawDeflate){
+        skipBytes = 8;
+      }
+      else{
+        inflateReset(&strm);
+      }
+    }
+    else if (ret == Z_DATA_ERROR && strm.total_in == 0 && strm.total_out == 0){
+      streamDone = true; // trailing garbage after the last member
+    }
+    else if (ret != Z_OK && ret != Z_BUF_ERROR){
+      printf("Corrupt trace file. Dying\n");
+      exit(-1);
+    }
+  }
+
+  got = (CBP_TRACE_BUF_SIZE - left) - strm.avail_out;
+  bufEnd += got;
+
+  return got > 0;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Restarts inflation at compressed offset in; bits is the number of bits
+// of the byte before it that still belong to the stream, window the 32KB
+// of output before the restart point. in == 0 restarts the whole file.
+
+void  CBP_TRACER::RestartStream(UINT64 in, int bits, const UINT8 *window){
+  strm.avail_in = 0;
+  skipBytes = 0;
+  streamDone = false;
+
+  if (in == 0){
+    lseek(fd, 0, SEEK_SET);
+    inflateReset2(&strm, 15 + 16);
+    rawDeflate = false;
+    return;
+  }
 
+  lseek(fd, in - (bits ? 1 : 0), SEEK_SET);
+  inflateReset2(&strm, -15);
+  rawDeflate = true;
+  if (bits){
+    UINT8 ch;
+    if (read(fd, &ch, 1) != 1){
+      printf("Unable to seek in the trace file. Dying\n");
+      exit(-1);
+    }
+    inflatePrime(&strm, bits, ch >> (8 - bits));
+  }
+  inflateSetDictionary(&strm, window, CBP_INDEX_WINDOW);
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// index file: magic, UINT64 compressed size, UINT32 point count, then per
+// point UINT64 out, UINT64 in, UINT32 bits, then the windows in order
+
+struct CBP_INDEX_POINT{
+  UINT64 out;     // uncompressed offset
+  UINT64 in;      // compressed offset
+  UINT32 bits;
+};
+
+// Restarts the stream at the last indexed point at or before offset and
+// returns its uncompressed position in *out; false without a usable index.
+
+bool  CBP_TRACER::FindRestartPoint(UINT64 offset, UINT64 *out){
+  std::string indexName = fileName + ".idx";
+  FILE  *fp = fopen(indexName.c_str(), "rb");
+  char   magic[8];
+  UINT64 traceBytes;
+  UINT32 numPoints;
+  struct stat st;
+  bool   ok = false;
+
+  if (fp == NULL){
+    return false;
+  }
+
+  if (fread(magic, 8, 1, fp) == 1 && memcmp(magic, CBP_INDEX_MAGIC, 8) == 0 &&
+      fread(&traceBytes, 8, 1, fp) == 1 && fread(&numPoints, 4, 1, fp) == 1 &&
+      fstat(fd, &st) == 0 && traceBytes == (UINT64) st.st_size){
+    std::vector<CBP_INDEX_POINT> points(numPoints);
+    UINT32 i, best = numPoints;
+
+    for (i = 0; i < numPoints; i++){
+      if (fread(&points[i].out, 8, 1, fp) != 1 || fread(&points[i].in, 8, 1, fp) != 1 ||
+          fread(&points[i].bits, 4, 1, fp) != 1){
+        break;
+      }
+      if (points[i].out <= offset){
+        best = i;
+      }
+    }
+
+    if (i == numPoints && best < numPoints){
+      std::vector<UINT8> window(CBP_INDEX_WINDOW);
+      long   pos = ftell(fp) + (long) best * CBP_INDEX_WINDOW;
+
+      if (fseek(fp, pos, SEEK_SET) == 0 && fread(&window[0], CBP_INDEX_WINDOW, 1, fp) == 1){
+        RestartStream(points[best].in, points[best].bits, &window[0]);
+        *out = points[best].out;
+        ok = true;
+      }
+    }
+  }
+
+  fclose(fp);
+  return ok;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+bool  CBP_TRACER::Seek(UINT64 inst){
+  UINT64 offset = inst * CBP_RECORD_SIZE;
+  UINT64 out = 0;
+
+  if (colMode){
+    if (inst > colHeader.numRecords){
+      return false;
+    }
+    regionStart = inst;
+    colChunk = inst / colHeader.chunkRecords;
+    eCount = eNext = 0;
+    colChunkStart = inst;
+    colChunkRecords = 0;
+    if (colChunk < colHeader.numChunks){
+      DecodeChunk(colChunk);
+      eNext = std::lower_bound(ePos.begin(), ePos.begin() + eCount,
+                               (UINT32) (inst - colChunkStart)) - ePos.begin();
+    }
+  }
+  else if (fd < 0){
+    if (offset > mapSize){
+      return false;
+    }
+    bufPos = offset;
+  }
+  else{
+    if (!FindRestartPoint(offset, &out)){
+      RestartStream(0, 0, NULL);
+    }
+
+    // inflate and drop what lies between the restart point and the target
+    bufPos = bufEnd = 0;
+    while (out + bufEnd < offset){
+      out += bufEnd;
+      bufPos = bufEnd;
+      if (!FillBuffer()){
+        return false;
+      }
+    }
+    bufPos = offset - out;
+  }
+
+  numInst=0;
+  numCondBranch=0;
+  lastHeartBeat=0;
+  lastSample=0;
+  nextSample=interval ? interval : ~0ULL;
+  return true;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Inflates the whole trace block by block and records a restart point at
+// the first block boundary after every span uncompressed bytes.
+
+int   CBP_TRACER::BuildIndex(const char *traceFileName, UINT64 span){
+  std::string indexName = std::string(traceFileName) + ".idx";
+  std::vector<CBP_INDEX_POINT> points;
+  std::vector<UINT8> windows;
+  std::vector<UINT8> input(CBP_TRACE_IN_SIZE), window(CBP_INDEX_WINDOW);
+  UINT64   totIn = 0, totOut = 0, last = 0;
+  UINT8    magic[2];
+  z_stream zs;
+  int      ret = Z_OK;
+  FILE    *in, *fp;
+  struct stat st;
+
+  if ((in = fopen(traceFileName, "rb")) == NULL || fstat(fileno(in), &st) < 0){
+    return -1;
+  }
+  if (fread(magic, 1, 2, in) != 2 || magic[0] != 0x1f || magic[1] != 0x8b){
+    fclose(in);
+    return 0;
+  }
+  rewind(in);
+
+  memset(&zs, 0, sizeof(zs));
+  inflateInit2(&zs, 15 + 16);
+  zs.avail_out = 0;
+
+  // single member: a restart point inside a later member would need its
+  // gzip header replayed, so indexing stops at the first stream end
+  do{
+    zs.avail_in = fread(&input[0], 1, input.size(), in);
+    zs.next_in = &input[0];
+    if (zs.avail_in == 0){
+      break;
+    }
+
+    do{
+      if (zs.avail_out == 0){
+        zs.avail_out = CBP_INDEX_WINDOW;
+        zs.next_out = &window[0];
+      }
+      totIn += zs.avail_in;
+      totOut += zs.avail_out;
+      ret = inflate(&zs, Z_BLOCK);
+      totIn -= zs.avail_in;
+      totOut -= zs.avail_out;
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR){
+        inflateEnd(&zs);
+        fclose(in);
+        return -1;
+      }
+      if (ret == Z_STREAM_END){
+        break;
+      }
+
+      // end of a deflate block that is not the last one
+      if ((zs.data_type & 128) && !(zs.data_type & 64) && totOut - last > span){
+        CBP_INDEX_POINT point = { totOut, totIn, (UINT32) (zs.data_type & 7) };
+        size_t left = zs.avail_out, base = windows.size();
+
+        windows.resize(base + CBP_INDEX_WINDOW);
+        memcpy(&windows[base], window.data() + CBP_INDEX_WINDOW - left, left);
+        memcpy(&windows[base] + left, window.data(), CBP_INDEX_WINDOW - left);
+        points.push_back(point);
+        last = totOut;
+      }
+    } while (zs.avail_in != 0);
+  } while (ret != Z_STREAM_END);
+
+  inflateEnd(&zs);
+  fclose(in);
+
+  UINT64 traceBytes = st.st_size;
+  UINT32 numPoints = points.size();
+
+  if ((fp = fopen(indexName.c_str(), "wb")) == NULL){
+    return -1;
+  }
+  fwrite(CBP_INDEX_MAGIC, 8, 1, fp);
+  fwrite(&traceBytes, 8, 1, fp);
+  fwrite(&numPoints, 4, 1, fp);
+  for (UINT32 i = 0; i < numPoints; i++){
+    fwrite(&points[i].out, 8, 1, fp);
+    fwrite(&points[i].in, 8, 1, fp);
+    fwrite(&points[i].bits, 4, 1, fp);
+  }
+  if (numPoints > 0){
+    fwrite(&windows[0], windows.size(), 1, fp);
+  }
+  if (fclose(fp) != 0){
+    return -1;
+  }
+
+  return numPoints;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Decodes chunk into the e* columns: only its branches in branch-only
+// mode, every record otherwise. ePos holds each entry's record number
+// within the chunk.
+
+void  CBP_TRACER::DecodeChunk(UINT32 chunk){
+  CBPC_CHUNK_HEADER hdr;
+  UINT64 offset;
+  const UINT8 *col[CBPC_NUM_COLS];
+  const UINT8 *p;
+  UINT32 i, b;
+
+  memcpy(&offset, mapBase + colHeader.dirOffset + (UINT64) chunk * 8, 8);
+  memcpy(&hdr, mapBase + offset, sizeof(hdr));
+  p = mapBase + offset + sizeof(hdr);
+  for (i = 0; i < CBPC_NUM_COLS; i++){
+    col[i] = p;
+    p += hdr.colBytes[i];
+  }
+
+  // static branches: PC, targets
+  std::vector<UINT32> sPC(hdr.numStatic), sFirst(hdr.numStatic), sCount(hdr.numStatic);
+  std::vector<UINT32> sTargets;
+  UINT32 pc = 0;
+
+  p = col[CBPC_COL_STATIC];
+  for (i = 0; i < hdr.numStatic; i++){
+    pc += CbpcUnZigZag(CbpcGetVarint(p));
+    sPC[i] = pc;
+    sCount[i] = CbpcGetVarint(p);
+    sFirst[i] = sTargets.size();
+    for (UINT32 t = 0; t < sCount[i]; t++){
+      sTargets.push_back(pc + CbpcUnZigZag(CbpcGetVarint(p)));
+    }
+  }
+
+  // branches
+  UINT32 n = branchOnly ? hdr.numBranches : hdr.numRecords;
+  const UINT8 *gap = col[CBPC_COL_GAP], *id = col[CBPC_COL_ID];
+  const UINT8 *taken = col[CBPC_COL_TAKEN], *target = col[CBPC_COL_TARGET];
+  const UINT8 *opType = col[CBPC_COL_OPTYPE];
+  UINT32 pos = 0;
+
+  ePC.resize(n);
+  eTarget.resize(n);
+  ePos.resize(n);
+  eOpType.resize(n);
+  eTaken.resize(n);
+
+  // in branch-only mode the branches go straight into the e* columns,
+  // otherwise into their record positions
+  for (b = 0; b < hdr.numBranches; b++){
+    UINT32 s = CbpcGetVarint(id);
+    UINT32 e = branchOnly ? b : 0;
+
+    pos += CbpcGetVarint(gap);
+    if (!branchOnly){
+      e = pos;
+    }
+    ePos[e] = pos;
+    ePC[e] = sPC[s];
+    eTarget[e] = sTargets[sFirst[s] + ((sCount[s] > 1) ? CbpcGetVarint(target) : 0)];
+    eTaken[e] = (taken[b >> 3] >> (b & 7)) & 1;
+    eOpType[e] = (opType[pos >> 1] >> ((pos & 1) * 4)) & 15;
+    pos++;
+  }
+
+  if (!branchOnly){
+    const UINT8 *delta = col[CBPC_COL_PC];
+    const UINT8 *except = col[CBPC_COL_EXCEPT];
+    UINT32 nextBranch = 0, numExc = hdr.numExceptions;
+
+    pc = 0;
+    for (i = 0; i < n; i++){
+      UINT8 op = (opType[i >> 1] >> ((i & 1) * 4)) & 15;
+      if (CbpcIsBranch(op)){
+        pc = ePC[i];
+        nextBranch++;
+        continue;
+      }
+      pc += CbpcUnZigZag(CbpcGetVarint(delta));
+      ePos[i] = i;
+      ePC[i] = pc;
+      eTarget[i] = pc;
+      eTaken[i] = 0;
+      eOpType[i] = op;
+    }
+
+    for (i = 0; i < numExc; i++){
+      UINT32 at = CbpcGetVarint(except);
+      memcpy(&eTarget[at], except, 4);
+      eTaken[at] = except[4];
+      except += 5;
+    }
+  }
+
+  colChunkStart = (UINT64) chunk * colHeader.chunkRecords;
+  colChunkRecords = hdr.numRecords;
+  colChunk = chunk + 1;
+  eCount = n;
+  eNext = 0;
+}
+
+// Index of the next e* entry to return, decoding chunks as needed, and
+// numInst brought up to date; false at the end of the trace or region.
+
+bool  CBP_TRACER::NextColumnar(UINT32 *idx){
+  for (;;){
+    if (eNext < eCount){
+      UINT64 at = colChunkStart + ePos[eNext] - regionStart;
+      if (at >= StopAt()){
+        numInst = StopAt();
+        return false;
+      }
+      numInst = at + 1;
+      *idx = eNext++;
+      return true;
+    }
+
+    // the rest of the chunk holds no branches (or nothing at all)
+    numInst = colChunkStart + colChunkRecords - regionStart;
+    if (numInst >= StopAt()){
+      numInst = StopAt();
+      return false;
+    }
+    if (colChunk >= colHeader.numChunks){
+      return false;
+    }
+    DecodeChunk(colChunk);
+  }
 }
 
 /////////////////////////////////////////
 /////////////////////////////////////////
 
 bool  CBP_TRACER::GetNextRecord(CBP_TRACE_RECORD *rec){
+  UINT8 *p;
+
+  CheckIntervals();
 
-  fread (&rec->PC, 4, 1, traceFile);
-  fread (&rec->branchTarget, 4, 1, traceFile);
-  fread (&rec->opType, 1, 1, traceFile);
-  fread (&rec->branchTaken, 1, 1, traceFile);
+  if (colMode){
+    UINT32 i;
 
-  if(feof(traceFile)){
-    return FAILURE; 
+    // a window may end between two branches: close it and go on
+    while (!NextColumnar(&i)){
+      if (numInst < nextSample || numInst >= instLimit){
+        FinishIntervals();
+        return FAILURE;
+      }
+      CheckIntervals();
+    }
+    rec->PC = ePC[i];
+    rec->branchTarget = eTarget[i];
+    rec->opType = (OpType) eOpType[i];
+    rec->branchTaken = eTaken[i];
+    assert(rec->opType < OPTYPE_MAX);
+
+    if(rec->opType == OPTYPE_BRANCH_COND){
+      numCondBranch++;
+    }
+    return SUCCESS;
+  }
+
+  if (numInst >= instLimit){
+    FinishIntervals();
+    return FAILURE;
+  }
+
+  while (bufEnd - bufPos < CBP_RECORD_SIZE){
+    if (!FillBuffer()){
+      FinishIntervals();
+      return FAILURE; 
+    }
   }
 
+  p = buf + bufPos;
+  bufPos += CBP_RECORD_SIZE;
+
+  memcpy(&rec->PC, p, 4);
+  memcpy(&rec->branchTarget, p + 4, 4);
+  rec->opType = (OpType) p[8];
+  rec->branchTaken = (p[9] != 0);
+
   // sanity check
   assert(rec->opType < OPTYPE_MAX);
 
-  // update trace stats and heartbeat
+  // update trace stats
   numInst++;
-  CheckHeartBeat();
 
   if(rec->opType == OPTYPE_BRANCH_COND){
     numCondBranch++;
@@ -63,17 +641,119 @@ bool  CBP_TRACER::GetNextRecord(CBP_TRACE_RECORD *rec){
 /////////////////////////////////////////
 /////////////////////////////////////////
 
-void CBP_TRACER::CheckHeartBeat(){
+// Decodes up to n records (n <= CBP_BATCH_SIZE) into batch and returns how
+// many were decoded; 0 means the trace is exhausted.
+
+UINT32 CBP_TRACER::GetNextBatch(CBP_TRACE_BATCH *batch, UINT32 n){
+  UINT32 count, numCond, numBranch, i;
+  UINT8 *p;
+
+  assert(n <= CBP_BATCH_SIZE);
+
+  CheckIntervals();
+
+  if (n > StopAt() - numInst){
+    n = StopAt() - numInst;
+  }
+
+  if (colMode){
+    // NextColumnar() also advances numInst over any skipped records; a
+    // window without branches is closed here rather than ending the trace
+    for (;;){
+      for (count = 0; count < n && NextColumnar(&i); count++){
+        batch->PC[count] = ePC[i];
+        batch->branchTarget[count] = eTarget[i];
+        batch->opType[count] = eOpType[i];
+        batch->branchTaken[count] = eTaken[i];
+      }
+      if (count > 0 || numInst < nextSample || numInst >= instLimit){
+        break;
+      }
+      CheckIntervals();
+    }
+  }
+  else{
+    while ((bufEnd - bufPos) / CBP_RECORD_SIZE < n && FillBuffer()){
+    }
+
+    count = (bufEnd - bufPos) / CBP_RECORD_SIZE;
+    if (count > n){
+      count = n;
+    }
+
+    p = buf + bufPos;
+    bufPos += (size_t) count * CBP_RECORD_SIZE;
+
+    for (i = 0; i < count; i++, p += CBP_RECORD_SIZE){
+      memcpy(&batch->PC[i], p, 4);
+      memcpy(&batch->branchTarget[i], p + 4, 4);
+      batch->opType[i] = p[8];
+      batch->branchTaken[i] = (p[9] != 0);
+    }
+
+    numInst += count;
+  }
+
+  numCond=0;
+  numBranch=0;
+  for (i = 0; i < count; i++){
+    // sanity check
+    assert(batch->opType[i] < OPTYPE_MAX);
+    batch->condIdx[numCond] = i;
+    numCond += (batch->opType[i] == OPTYPE_BRANCH_COND);
+    batch->branchIdx[numBranch] = i;
+    numBranch += (batch->opType[i] >= OPTYPE_CALL_DIRECT);
+  }
+
+  batch->numCond = numCond;
+  batch->numBranch = numBranch;
+  batch->size = count;
+
+  // update trace stats
+  numCondBranch += numCond;
+  if (count == 0){
+    FinishIntervals();
+  }
+
+  return count;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+void CBP_TRACER::SetInterval(UINT64 n, std::function<void (UINT64)> fn){
+  interval=n;
+  onInterval=fn;
+  lastSample=numInst;
+  nextSample=n ? numInst + n : ~0ULL;
+}
+
+// Called before each record or batch is read, when the caller is done
+// with everything returned so far: closes the windows that end here and
+// prints the heartbeat.
+
+void CBP_TRACER::CheckIntervals(){
   UINT64 dotInterval=1000000;
   UINT64 lineInterval=30*dotInterval;
 
-  if(numInst-lastHeartBeat >= dotInterval){
+  while(numInst >= nextSample){
+    onInterval(nextSample);
+    lastSample=nextSample;
+    nextSample+=interval;
+  }
+
+  if(!heartBeat){
+    return;
+  }
+
+  // batches advance numInst by more than one, so catch up dot by dot
+  while(numInst-lastHeartBeat >= dotInterval){
     printf("."); 
     fflush(stdout);
 
-    lastHeartBeat=numInst;
+    lastHeartBeat+=dotInterval;
 
-    if(numInst % lineInterval == 0){
+    if(lastHeartBeat % lineInterval == 0){
       printf("\n");
       fflush(stdout);
     }
@@ -81,5 +761,15 @@ void CBP_TRACER::CheckHeartBeat(){
   }
 
 }
+
+// the trace ended: report the partial window left, if any
+
+void CBP_TRACER::FinishIntervals(){
+  CheckIntervals();
+  if(interval && numInst > lastSample){
+    onInterval(numInst);
+    lastSample=numInst;
+  }
+}
 /////////////////////////////////////////
 /////////////////////////////////////////
@@ -1,7 +1,11 @@
 #ifndef _TRACER_H_
 #define _TRACER_H_
 
+#include <zlib.h>
+#include <vector>
+#include <functional>
 #include "utils.h"
+#include "columnar.h"
 
 /////////////////////////////////////////
 /////////////////////////////////////////
@@ -38,27 +42,140 @@ class CBP_TRACE_RECORD{
 };
 
 
+// records decoded per GetNextBatch call, at most
+#define CBP_BATCH_SIZE       4096
+
+// A block of consecutive trace records, stored field by field so a
+// predictor loop touches only the columns it needs. condIdx lists the
+// positions of the conditional branches in the block, branchIdx those of
+// all control transfers (conditional or not).
+
+class CBP_TRACE_BATCH{
+  public:
+  UINT32   PC[CBP_BATCH_SIZE];
+  UINT32   branchTarget[CBP_BATCH_SIZE];
+  UINT8    opType[CBP_BATCH_SIZE];
+  UINT8    branchTaken[CBP_BATCH_SIZE];
+
+  UINT32   condIdx[CBP_BATCH_SIZE];
+  UINT32   numCond;
+  UINT32   branchIdx[CBP_BATCH_SIZE];
+  UINT32   numBranch;
+  UINT32   size;
+
+  CBP_TRACE_BATCH(){
+    numCond=0;
+    numBranch=0;
+    size=0;
+  }
+};
+
+
 /////////////////////////////////////////
 /////////////////////////////////////////
 
+// on-disk record: PC(4) branchTarget(4) opType(1) branchTaken(1), little endian
+#define CBP_RECORD_SIZE      10
+
+// gzip traces are inflated in-process into a buffer of this many bytes
+#define CBP_TRACE_BUF_SIZE   (4 << 20)
+#define CBP_TRACE_IN_SIZE    (1 << 20)
+
+// A gzip trace can be given a sidecar index, <trace>.idx, of restart
+// points: positions in the compressed stream (at deflate block
+// boundaries) where inflation can resume given the 32KB of output that
+// precede them. Seek() starts from the nearest point at or before the
+// target instead of inflating the trace from its start.
+#define CBP_INDEX_MAGIC      "CBPIDX1"
+#define CBP_INDEX_WINDOW     32768
+#define CBP_INDEX_SPAN       (16 << 20)   // uncompressed bytes between points
+
 class CBP_TRACER{
  private:
-  FILE *traceFile;
-
-  UINT64 numInst;        
+  std::string fileName;
+  int       fd;            // compressed trace (-1 when mmap'd)
+  z_stream  strm;
+  UINT8    *inBuf;
+  bool      rawDeflate;    // resumed at a restart point: no gzip header
+  UINT32    skipBytes;     // gzip trailer still to skip after a raw stream
+  bool      streamDone;
+
+  UINT8  *mapBase;       // uncompressed trace mapped read-only (NULL when gzip)
+  size_t  mapSize;
+
+  // columnar traces: the mapping holds the whole file, one chunk at a time
+  // is decoded into the e* columns (every record, or only the branches)
+  bool    colMode;
+  bool    branchOnly;
+  CBPC_FILE_HEADER colHeader;
+  UINT32  colChunk;        // next chunk to decode
+  UINT64  colChunkStart;   // instruction number of the decoded chunk's first record
+  UINT32  colChunkRecords;
+  std::vector<UINT32> ePC, eTarget, ePos;
+  std::vector<UINT8>  eOpType, eTaken;
+  UINT32  eCount, eNext;
+  UINT64  regionStart;     // instruction number Seek() moved to
+
+  UINT8  *buf;           // decoded bytes: inflate buffer or the mapping itself
+  size_t  bufPos;
+  size_t  bufEnd;
+
+  UINT64 numInst;          // records read since the start or the last Seek()
   UINT64 numCondBranch;
+  UINT64 instLimit;        // stop after this many records
 
   UINT64 lastHeartBeat;
+  bool   heartBeat;
+
+  // interval sampling: onInterval(end) once the records before instruction
+  // end (counted like numInst) have been returned and processed
+  UINT64 interval;         // 0: no sampling
+  UINT64 nextSample;       // end of the current window, ~0 without sampling
+  UINT64 lastSample;
+  std::function<void (UINT64)> onInterval;
 
  public:
   CBP_TRACER(char *traceFileName);
+  ~CBP_TRACER();
 
   bool   GetNextRecord(CBP_TRACE_RECORD *record);  
+  UINT32 GetNextBatch(CBP_TRACE_BATCH *batch, UINT32 n);
   UINT64 GetNumInst(){ return numInst; }
   UINT64 GetNumCondBranch(){ return numCondBranch; }
+  void   SetHeartBeat(bool enable){ heartBeat = enable; }
+
+  // Calls fn(end) for every window of n instructions, and for the partial
+  // window left at the end of the trace, once the caller has processed all
+  // the records before end: fn is called from the GetNext* call that
+  // follows the window, so counters kept by the caller are exact. Batches
+  // never straddle a window boundary. Windows restart at Seek().
+  void   SetInterval(UINT64 n, std::function<void (UINT64)> fn);
+
+  // Positions the trace so the next record is instruction inst (counted
+  // from 0) and restarts the counts; false if the trace is shorter.
+  bool   Seek(UINT64 inst);
+
+  // Ends the trace after n more records.
+  void   SetLimit(UINT64 n){ instLimit = n; }
+
+  // Lets the tracer return only control transfers. Columnar traces then
+  // skip everything else without decoding it; instruction counts still
+  // include the skipped records. Other formats return every record.
+  void   SetBranchOnly(bool enable){ branchOnly = enable; }
+
+  // Writes <trace>.idx for a gzip trace; returns the number of restart
+  // points, 0 for an uncompressed trace (which seeks directly) or -1 on error.
+  static int BuildIndex(const char *traceFileName, UINT64 span);
 
  private:
-  void   CheckHeartBeat();
+  bool   FillBuffer();
+  void   CheckIntervals();
+  void   FinishIntervals();
+  UINT64 StopAt(){ return nextSample < instLimit ? nextSample : instLimit; }
+  void   RestartStream(UINT64 in, int bits, const UINT8 *window);
+  bool   FindRestartPoint(UINT64 offset, UINT64 *out);
+  void   DecodeChunk(UINT32 chunk);
+  bool   NextColumnar(UINT32 *idx);
 };
 
 
@@ -21,7 +21,10 @@
 
 using namespace std;
 
+#define UINT8       unsigned char
+#define UINT16      unsigned short
 #define UINT32      unsigned int
+#define INT8        signed char
 #define INT32       int
 #define UINT64      unsigned long long
 #define COUNTER     unsigned long long
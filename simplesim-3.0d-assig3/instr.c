@@ -4,77 +4,250 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "instr.h"
 
-//prints a single instruction
-static void print_tom_instr(instruction_t* instr) {
+//prints an instruction's row of the Tomasulo table to stdout, with its
+//commit cycle if commit is set
+void print_tom_instr(instruction_t* instr, bool commit) {
 
   md_print_insn(instr->inst, instr->pc, stdout);
-  myfprintf(stdout, "\t%d\t%d\t%d\t%d\n", 
+  myfprintf(stdout, "\t%d\t%d\t%d\t%d", 
 	    instr->tom_dispatch_cycle,
 	    instr->tom_issue_cycle,
 	    instr->tom_execute_cycle,
 	    instr->tom_cdb_cycle);
+  if (commit)
+    myfprintf(stdout, "\t%d", instr->tom_commit_cycle);
+  fprintf(stdout, "\n");
 }
 
+//starts the log
+void write_tom_header(FILE* log, bool commit) {
 
-//prints all the instructions inside the given trace for pipeline
-void print_all_instr(instruction_trace_t* trace, int sim_num_insn) {
+  int flag = commit;
 
-  fprintf(stdout, "TOMASULO TABLE\n");
+  fwrite(TOM_LOG_MAGIC, sizeof(TOM_LOG_MAGIC), 1, log);
+  fwrite(&flag, sizeof(flag), 1, log);
+}
 
-  int printed_count = 0;
-  int index = 1;
-  while (true) {
- 
-     if (1) { // if (printed_count > 9999900) {
-        print_tom_instr(&trace->table[index]);
-     }
+//checks the start of a log, and gets whether it has commit cycles; false if
+//it is not a log
+bool read_tom_header(FILE* log, bool* commit) {
 
-     printed_count++;
+  char magic[sizeof(TOM_LOG_MAGIC)];
+  int flag;
 
-     if (printed_count == sim_num_insn)
-        break;
-      
-     if (++index == INSTR_TRACE_SIZE) {
-        trace = trace->next;
-	index = 0;
-	if (trace == NULL)
-	   break;
-     }
-   }
+  if (fread(magic, sizeof(magic), 1, log) != 1
+      || memcmp(magic, TOM_LOG_MAGIC, sizeof(magic)) != 0
+      || fread(&flag, sizeof(flag), 1, log) != 1)
+    return false;
+
+  *commit = flag;
+  return true;
+}
+
+
+//appends the instruction's record to the log
+void write_tom_record(FILE* log, instruction_t* instr) {
+
+  tom_log_record_t record;
+
+  memset(&record, 0, sizeof(record));
+  record.inst = instr->inst;
+  record.pc = instr->pc;
+  record.index = instr->index;
+  record.tom_dispatch_cycle = instr->tom_dispatch_cycle;
+  record.tom_issue_cycle = instr->tom_issue_cycle;
+  record.tom_execute_cycle = instr->tom_execute_cycle;
+  record.tom_cdb_cycle = instr->tom_cdb_cycle;
+  record.tom_commit_cycle = instr->tom_commit_cycle;
+  fwrite(&record, sizeof(record), 1, log);
+}
+
+//reads the next record of the log into instr; false at the end of the log
+bool read_tom_record(FILE* log, instruction_t* instr) {
+
+  tom_log_record_t record;
+
+  if (fread(&record, sizeof(record), 1, log) != 1)
+    return false;
+
+  memset(instr, 0, sizeof(instruction_t));
+  instr->inst = record.inst;
+  instr->pc = record.pc;
+  instr->index = record.index;
+  instr->tom_dispatch_cycle = record.tom_dispatch_cycle;
+  instr->tom_issue_cycle = record.tom_issue_cycle;
+  instr->tom_execute_cycle = record.tom_execute_cycle;
+  instr->tom_cdb_cycle = record.tom_cdb_cycle;
+  instr->tom_commit_cycle = record.tom_commit_cycle;
+  return true;
+}
+
+//instructions put between two hand-overs to the reader
+#define INSTR_PUBLISH_SIZE 256
+
+//creates a trace holding at least window instructions; 0 means unbounded
+instruction_trace_t* new_instr_trace(int window) {
+
+  instruction_trace_t* trace = malloc(sizeof(instruction_trace_t));
+  assert(trace != NULL);
+  memset(trace, 0, sizeof(instruction_trace_t));
+
+  trace->tail = malloc(sizeof(instruction_list_t));
+  assert(trace->tail != NULL);
+  memset(trace->tail, 0, sizeof(instruction_list_t));
+  trace->head = trace->cursor = trace->tail;
+  trace->num_chunks = 1;
+
+  //a window can straddle one chunk more than it fills
+  if (window > 0)
+     trace->max_chunks = (window + INSTR_TRACE_SIZE - 1) / INSTR_TRACE_SIZE + 1;
+
+  //skip the first entry: instruction indices start at 1
+  trace->tail_size = trace->size = trace->visible = trace->cursor_visible = 1;
+  trace->retired = 1;
+
+  pthread_mutex_init(&trace->lock, NULL);
+  pthread_cond_init(&trace->cond, NULL);
+  return trace;
 }
 
 //inserts the instruction into the trace
 void put_instr(instruction_trace_t* trace, instruction_t* instr) {
 
-  while ((trace->size == INSTR_TRACE_SIZE) && (trace->next != NULL)) {
-    trace = trace->next;
+  instruction_list_t* chunk;
+
+  if (trace->tail_size == INSTR_TRACE_SIZE) {
+
+     pthread_mutex_lock(&trace->lock);
+     trace->visible = trace->size;
+     pthread_cond_broadcast(&trace->cond);
+     while (trace->max_chunks && trace->num_chunks >= trace->max_chunks) {
+        trace->full = true;
+        pthread_cond_broadcast(&trace->cond);
+        pthread_cond_wait(&trace->cond, &trace->lock);
+     }
+     trace->full = false;
+
+     chunk = trace->spare;
+     if (chunk != NULL) {
+        trace->spare = chunk->next;
+     } else {
+        chunk = malloc(sizeof(instruction_list_t));
+        assert(chunk != NULL);
+     }
+     chunk->next = NULL;
+     trace->tail->next = chunk;
+     trace->num_chunks++;
+     pthread_mutex_unlock(&trace->lock);
+
+     trace->tail = chunk;
+     trace->tail_size = 0;
   }
-  
-  if (trace->size == INSTR_TRACE_SIZE) {
-      
-     trace->next = malloc(sizeof(instruction_trace_t));
-     assert(trace->next != NULL);
-     //printf("trace=%p\n", trace);
-     trace = trace->next;
-     memset(trace, 0, sizeof(instruction_trace_t));
+  trace->tail->table[trace->tail_size++] = *instr;
+
+  if (++trace->size % INSTR_PUBLISH_SIZE == 0) {
+     pthread_mutex_lock(&trace->lock);
+     trace->visible = trace->size;
+     pthread_cond_broadcast(&trace->cond);
+     pthread_mutex_unlock(&trace->lock);
   }
-  trace->table[trace->size++] = *instr;
 } 
 
-//gets the instruction at the index, from the trace
+//marks the end of the trace; put_instr must not be called afterwards
+void finish_instr_trace(instruction_trace_t* trace) {
+
+  pthread_mutex_lock(&trace->lock);
+  trace->visible = trace->size;
+  trace->done = true;
+  pthread_cond_broadcast(&trace->cond);
+  pthread_mutex_unlock(&trace->lock);
+}
+
+//gets the instruction at the index, from the trace; indices must be asked
+//for in increasing order, and NULL is returned past the end of the trace
 instruction_t* get_instr(instruction_trace_t* trace, int index) {
 
-  while (index >= INSTR_TRACE_SIZE) {
-     index -= INSTR_TRACE_SIZE;
-     trace = trace->next;
+  assert(index >= trace->cursor_first);
+
+  if (index >= trace->cursor_visible) {
+     pthread_mutex_lock(&trace->lock);
+     while (index >= trace->visible && !trace->done) {
+        //the writer can only be waiting on instructions we have not
+        //reached yet; grow the window rather than wait on each other
+        if (trace->full) {
+           trace->max_chunks++;
+           pthread_cond_broadcast(&trace->cond);
+        }
+        pthread_cond_wait(&trace->cond, &trace->lock);
+     }
+     trace->cursor_visible = trace->visible;
+     pthread_mutex_unlock(&trace->lock);
+
+     if (index >= trace->cursor_visible)
+        return NULL;
+  }
 
-     assert(trace != NULL);
+  while (index - trace->cursor_first >= INSTR_TRACE_SIZE) {
+     trace->cursor = trace->cursor->next;
+     trace->cursor_first += INSTR_TRACE_SIZE;
   }
+  return &trace->cursor->table[index - trace->cursor_first];
+}
+
+//hands, in order, the instructions below the index that are done and
+//have not been yet to retire (if not NULL), and releases the chunks
+//holding them
+void retire_instr(instruction_trace_t* trace, int index,
+                  void (*retire)(instruction_t* instr)) {
+
+  instruction_list_t* chunk;
+  instruction_t* instr;
+
+  while (trace->retired < index) {
+
+     //a chunk goes back once all of it retired and the writer moved on
+     if (trace->retired - trace->first == INSTR_TRACE_SIZE) {
+        pthread_mutex_lock(&trace->lock);
+        chunk = trace->head;
+        trace->head = chunk->next;
+        chunk->next = trace->spare;
+        trace->spare = chunk;
+        trace->num_chunks--;
+        pthread_cond_broadcast(&trace->cond);
+        pthread_mutex_unlock(&trace->lock);
+        trace->first += INSTR_TRACE_SIZE;
+     }
 
-  return &trace->table[index];
+     instr = &trace->head->table[trace->retired - trace->first];
+     if (!instr->done)
+        break;
+     if (retire != NULL)
+        retire(instr);
+     trace->retired++;
+  }
 }
 
+//frees every chunk of the trace, and the trace
+void free_instr_trace(instruction_trace_t* trace) {
+
+  instruction_list_t* chunk;
+
+  while (trace->head != NULL) {
+     chunk = trace->head;
+     trace->head = chunk->next;
+     free(chunk);
+  }
+  while (trace->spare != NULL) {
+     chunk = trace->spare;
+     trace->spare = chunk->next;
+     free(chunk);
+  }
+  pthread_mutex_destroy(&trace->lock);
+  pthread_cond_destroy(&trace->cond);
+  free(trace);
+}
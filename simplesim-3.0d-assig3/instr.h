@@ -2,8 +2,21 @@
 #ifndef INSTR_H
 #define INSTR_H
 
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
 #include "machine.h"
 
+struct my_instruction;
+
+//one of an instruction's operands waiting on another instruction's result
+typedef struct my_wait_link
+{
+  struct my_instruction* instr; //the waiting instruction
+  struct my_wait_link* next;    //the next operand waiting on the same producer
+}wait_link_t;
+
 //data structure representing each instruction
 typedef struct my_instruction
 {
@@ -14,35 +27,130 @@ typedef struct my_instruction
   int r_in[3]; //input registers
   enum md_opcode op; //opcode
   md_addr_t pc; //program counter the instruction executes at
+  md_addr_t npc; //program counter of the instruction executed next
+  md_addr_t target; //target of a control instruction, whether taken or not
+  md_addr_t mem_addr; //first byte a load or store accesses
+  int mem_size;       //number of bytes it accesses
 
   //the equivalents of Qj, Qk; these are pointers to the instructions producing the results
   // for the input registers of this instruction
   struct my_instruction * Q[3]; 
 
+  //wait[i] links Q[i] into its producer's list of waiting operands
+  wait_link_t wait[3];
+  wait_link_t* waiters;  //operands of later instructions waiting on this one
+  int num_waiting;       //entries of Q still waiting
+
+  bool addr_ready;       //a load or store has computed its address (with an LSQ)
+  int mem_ready_cycle;   //cycle a load's data arrives, 0 until it accesses memory
+  bool completed;        //finished executing, may commit (with a ROB)
+  bool mispredicted;     //a control instruction whose next PC was mispredicted
+  bool done;             //set once the instruction has left the pipeline
+
   //Specify the cycle an instruction **entered** this stage
   int tom_dispatch_cycle;  //dispatch
   int tom_issue_cycle;     //issue
   int tom_execute_cycle;   //execute
   int tom_cdb_cycle;       //writeback via Common Data Bus (CDB)
+  int tom_commit_cycle;    //commit from the reorder buffer, if there is one
 
 }instruction_t;
 
 #define INSTR_TRACE_SIZE 16384
 
+//a chunk of INSTR_TRACE_SIZE consecutive instructions
 typedef struct my_instruction_list
 {
   instruction_t table[INSTR_TRACE_SIZE];
-  int size;
   struct my_instruction_list* next;
+}instruction_list_t;
+
+//bounded window over the dynamic instruction stream: the functional
+//simulator appends with put_instr, the pipeline reads in order with
+//get_instr and hands instructions back with retire_instr once they have
+//left it, so only the chunks from the oldest unretired instruction to the
+//newest one are kept. With a bounded window put_instr waits while it is
+//full, which lets the two sides run on separate threads.
+typedef struct my_instruction_trace
+{
+  //writer side
+  instruction_list_t* tail;   //chunk put_instr fills
+  int tail_size;              //entries used in tail
+  int size;                   //instructions put so far, index 0 included
+
+  //reader side
+  instruction_list_t* head;   //oldest live chunk, its first entry is index first
+  int first;
+  instruction_list_t* cursor; //chunk get_instr last read, starting at cursor_first
+  int cursor_first;
+  int cursor_visible;         //the reader's copy of visible
+  int retired;                //every instruction below this index is retired
+
+  //shared, under lock
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int visible;                //instructions get_instr may read
+  bool done;                  //put_instr will not be called again
+  bool full;                  //put_instr is waiting for a chunk to retire
+  int num_chunks;
+  int max_chunks;             //0 when unbounded
+  instruction_list_t* spare;  //retired chunks, reused by put_instr
 }instruction_trace_t;
 
-//prints all the instructions inside the given trace
-extern void print_all_instr(instruction_trace_t* table, int sim_num_insn);
+//prints an instruction's row of the Tomasulo table to stdout, with its
+//commit cycle if commit is set
+extern void print_tom_instr(instruction_t* instr, bool commit);
+
+//the binary pipeline log: TOM_LOG_MAGIC, whether commit cycles are
+//meaningful, then one record per instruction in program order, all in
+//host byte order
+#define TOM_LOG_MAGIC "tomlog2"
+
+typedef struct my_log_record
+{
+  md_inst_t inst;
+  md_addr_t pc;
+  int index;
+  int tom_dispatch_cycle;
+  int tom_issue_cycle;
+  int tom_execute_cycle;
+  int tom_cdb_cycle;
+  int tom_commit_cycle;
+}tom_log_record_t;
+
+//starts the log
+extern void write_tom_header(FILE* log, bool commit);
+
+//checks the start of a log, and gets whether it has commit cycles; false if
+//it is not a log
+extern bool read_tom_header(FILE* log, bool* commit);
+
+//appends the instruction's record to the log
+extern void write_tom_record(FILE* log, instruction_t* instr);
+
+//reads the next record of the log into instr; false at the end of the log
+extern bool read_tom_record(FILE* log, instruction_t* instr);
+
+//creates a trace holding at least window instructions; 0 means unbounded
+extern instruction_trace_t* new_instr_trace(int window);
 
 //inserts the instruction into the trace
 extern void put_instr(instruction_trace_t* trace, instruction_t* instr);
 
-//gets the instruction at the index, from the trace
+//marks the end of the trace; put_instr must not be called afterwards
+extern void finish_instr_trace(instruction_trace_t* trace);
+
+//gets the instruction at the index, from the trace; indices must be asked
+//for in increasing order, and NULL is returned past the end of the trace
 extern instruction_t* get_instr(instruction_trace_t* trace, int index);
 
+//hands, in order, the instructions below the index that are done and
+//have not been yet to retire (if not NULL), and releases the chunks
+//holding them
+extern void retire_instr(instruction_trace_t* trace, int index,
+                         void (*retire)(instruction_t* instr));
+
+//frees every chunk of the trace, and the trace
+extern void free_instr_trace(instruction_trace_t* trace);
+
 #endif
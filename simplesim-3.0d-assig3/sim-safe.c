@@ -52,6 +52,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "host.h"
 #include "misc.h"
@@ -88,6 +89,14 @@ static counter_t sim_num_refs = 0;
 
 /* ECE552 BEGIN */
 static counter_t sim_num_tom_cycles = 0;
+
+/* the Tomasulo machine's own options, in tomasulo.c */
+extern void tomasulo_reg_options(struct opt_odb_t *odb);
+extern void tomasulo_check_options(void);
+extern void tomasulo_reg_stats(struct stat_sdb_t *sdb);
+
+/* instructions the functional simulator may run ahead of the timing model */
+static unsigned int tom_window;
 /* ECE552 END */
 
 /* maximum number of inst's to execute */
@@ -110,13 +119,24 @@ sim_reg_options(struct opt_odb_t *odb)
 	       &max_insts, /* default */0,
 	       /* print */TRUE, /* format */NULL);
 
+  /* ECE552 BEGIN */
+  tomasulo_reg_options(odb);
+  opt_reg_uint(odb, "-tom:window",
+	       "instructions the timing model trails the functional simulator "
+	       "by, at most (0 = unbounded, simulated after it)",
+	       &tom_window, /* default */65536,
+	       /* print */TRUE, /* format */NULL);
+  /* ECE552 END */
+
 }
 
 /* check simulator-specific option values */
 void
 sim_check_options(struct opt_odb_t *odb, int argc, char **argv)
 {
-  /* nada */
+  /* ECE552 BEGIN */
+  tomasulo_check_options();
+  /* ECE552 END */
 }
 
 /* register simulator-specific statistics */
@@ -141,6 +161,7 @@ sim_reg_stats(struct stat_sdb_t *sdb)
   stat_reg_counter(sdb, "sim_num_tom_cycles",
 		   "total number of cycles with tomasulo",
 		   &sim_num_tom_cycles, 0, NULL);
+  tomasulo_reg_stats(sdb);
   /* ECE552 END */
 
   ld_reg_stats(sdb);
@@ -189,11 +210,18 @@ sim_aux_stats(FILE *stream)		/* output stream */
   /* nada */
 }
 
+/* ECE552 BEGIN */
+static void finish_tomasulo(void);
+/* ECE552 END */
+
 /* un-initialize simulator-specific state */
 void
 sim_uninit(void)
 {
-  /* nada */
+  /* ECE552 BEGIN */
+  /* in case the simulator exits some other way */
+  finish_tomasulo();
+  /* ECE552 END */
 }
 
 
@@ -208,6 +236,12 @@ sim_uninit(void)
 /* next program counter */
 #define SET_NPC(EXPR)		(regs.regs_NPC = (EXPR))
 
+/* ECE552 BEGIN */
+/* target program counter, recorded for the timing model's branch predictor */
+#undef  SET_TPC
+#define SET_TPC(EXPR)		(m_instr.target = (EXPR))
+/* ECE552 END */
+
 /* current program counter */
 #define CPC			(regs.regs_PC)
 
@@ -285,11 +319,98 @@ sim_uninit(void)
   ((FAULT) = md_fault_none, addr = (DST), MEM_WRITE_QWORD(mem, addr, (SRC)))
 #endif /* HOST_HAS_QWORD */
 
+/* ECE552 BEGIN */
+/* widen the bytes INSTR touches in memory to cover [ADDR, ADDR+SIZE), for
+   the timing model's load/store queue; double-word accesses are made of
+   two word accesses */
+static void
+trace_mem_ref(instruction_t *instr, md_addr_t addr, int size)
+{
+  md_addr_t lo = addr, hi = addr + size;
+
+  if (instr->mem_size)
+    {
+      lo = MIN(lo, instr->mem_addr);
+      hi = MAX(hi, instr->mem_addr + instr->mem_size);
+    }
+  instr->mem_addr = lo;
+  instr->mem_size = hi - lo;
+}
+
+#undef  READ_BYTE
+#define READ_BYTE(SRC, FAULT)						\
+  ((FAULT) = md_fault_none, addr = (SRC),				\
+   trace_mem_ref(&m_instr, addr, 1), MEM_READ_BYTE(mem, addr))
+#undef  READ_HALF
+#define READ_HALF(SRC, FAULT)						\
+  ((FAULT) = md_fault_none, addr = (SRC),				\
+   trace_mem_ref(&m_instr, addr, 2), MEM_READ_HALF(mem, addr))
+#undef  READ_WORD
+#define READ_WORD(SRC, FAULT)						\
+  ((FAULT) = md_fault_none, addr = (SRC),				\
+   trace_mem_ref(&m_instr, addr, 4), MEM_READ_WORD(mem, addr))
+#ifdef HOST_HAS_QWORD
+#undef  READ_QWORD
+#define READ_QWORD(SRC, FAULT)						\
+  ((FAULT) = md_fault_none, addr = (SRC),				\
+   trace_mem_ref(&m_instr, addr, 8), MEM_READ_QWORD(mem, addr))
+#endif /* HOST_HAS_QWORD */
+
+#undef  WRITE_BYTE
+#define WRITE_BYTE(SRC, DST, FAULT)					\
+  ((FAULT) = md_fault_none, addr = (DST),				\
+   trace_mem_ref(&m_instr, addr, 1), MEM_WRITE_BYTE(mem, addr, (SRC)))
+#undef  WRITE_HALF
+#define WRITE_HALF(SRC, DST, FAULT)					\
+  ((FAULT) = md_fault_none, addr = (DST),				\
+   trace_mem_ref(&m_instr, addr, 2), MEM_WRITE_HALF(mem, addr, (SRC)))
+#undef  WRITE_WORD
+#define WRITE_WORD(SRC, DST, FAULT)					\
+  ((FAULT) = md_fault_none, addr = (DST),				\
+   trace_mem_ref(&m_instr, addr, 4), MEM_WRITE_WORD(mem, addr, (SRC)))
+#ifdef HOST_HAS_QWORD
+#undef  WRITE_QWORD
+#define WRITE_QWORD(SRC, DST, FAULT)					\
+  ((FAULT) = md_fault_none, addr = (DST),				\
+   trace_mem_ref(&m_instr, addr, 8), MEM_WRITE_QWORD(mem, addr, (SRC)))
+#endif /* HOST_HAS_QWORD */
+/* ECE552 END */
+
 /* system call handler macro */
 #define SYSCALL(INST)	sys_syscall(&regs, mem_access, mem, INST, TRUE)
 
 /* ECE552 BEGIN */
 instruction_trace_t* instruction_trace;
+
+extern counter_t runTomasulo(instruction_trace_t* trace);
+
+/* the timing model, when it runs alongside the functional simulator */
+static pthread_t tom_thread;
+static int tom_threaded = FALSE;
+
+static void *
+tomasulo_main(void *trace)
+{
+  sim_num_tom_cycles = runTomasulo(trace);
+  return NULL;
+}
+
+/* end the trace, and let the timing model drain it */
+static void
+finish_tomasulo(void)
+{
+  if (!instruction_trace)
+    return;
+
+  finish_instr_trace(instruction_trace);
+  if (tom_threaded)
+    pthread_join(tom_thread, NULL);
+  else
+    sim_num_tom_cycles = runTomasulo(instruction_trace);
+
+  free_instr_trace(instruction_trace);
+  instruction_trace = NULL;
+}
 /* ECE552 END */
 
 /* start simulation, program loaded, processor precise state initialized */
@@ -306,11 +427,13 @@ sim_main(void)
   instruction_t m_instr;
   memset(&m_instr, 0, sizeof(instruction_t));
 
-  instruction_trace = malloc(sizeof(instruction_trace_t));
-  assert(instruction_trace != NULL);
-  memset(instruction_trace, 0, sizeof(instruction_trace_t));
-  //skip the first entry
-  instruction_trace->size++;
+  /* the table printer shares myfprintf()'s buffers with verbose output
+     and the debugger, so those keep the timing model on this thread */
+  tom_threaded = tom_window && !verbose && !dlite_active;
+  instruction_trace = new_instr_trace(tom_threaded ? tom_window : 0);
+  if (tom_threaded
+      && pthread_create(&tom_thread, NULL, tomasulo_main, instruction_trace))
+    fatal("cannot start the timing model thread");
   /* ECE552 END */
 
   fprintf(stderr, "sim: ** starting functional simulation **\n");
@@ -351,6 +474,20 @@ sim_main(void)
       m_instr.inst = inst;
       m_instr.pc = regs.regs_PC;
       m_instr.op = op;
+      m_instr.target = 0;
+      m_instr.mem_addr = 0;
+      m_instr.mem_size = 0;
+
+      /* the exit system call does not come back: it jumps to exit_now(),
+	 which prints the stats, so the timing model finishes first */
+      if ((MD_OP_FLAGS(op) & F_TRAP) && MD_EXIT_SYSCALL(&regs))
+	{
+	  m_instr.r_out[0] = m_instr.r_out[1] = DNA;
+	  m_instr.r_in[0] = m_instr.r_in[1] = m_instr.r_in[2] = DNA;
+	  m_instr.npc = regs.regs_NPC;
+	  put_instr(instruction_trace, &m_instr);
+	  finish_tomasulo();
+	}
       /* ECE552 END */
 
       /* execute the instruction */
@@ -374,6 +511,7 @@ sim_main(void)
       }
 
       /* ECE552 BEGIN */
+      m_instr.npc = regs.regs_NPC;
       put_instr(instruction_trace, &m_instr);
       /* ECE552 END */
 
@@ -415,14 +553,7 @@ sim_main(void)
     }
 
 
-	//print_all_instr(instruction_trace, sim_num_insn);
-
     /* ECE552 BEGIN */
-
-    sim_num_tom_cycles = runTomasulo(instruction_trace);
-  
-    print_all_instr(instruction_trace, sim_num_insn);
-
-    free(instruction_trace);
+    finish_tomasulo();
     /* ECE552 END */
 }
@@ -18,20 +18,61 @@
 #include "stats.h"
 #include "sim.h"
 #include "decode.def"
+#include "bpred.h"
+#include "cache.h"
 
 #include "instr.h"
 
 /* PARAMETERS OF THE TOMASULO'S ALGORITHM */
 
-#define INSTR_QUEUE_SIZE         10
-
-#define RESERV_INT_SIZE    4
-#define RESERV_FP_SIZE     2
-#define FU_INT_SIZE        2
-#define FU_FP_SIZE         1
-
-#define FU_INT_LATENCY     4
-#define FU_FP_LATENCY      9
+//set through the -tom: options, see tomasulo_reg_options
+static int ifq_size;
+
+static int reserv_int_size;
+static int reserv_fp_size;
+static int fu_int_size;
+static int fu_fp_size;
+
+static int fu_int_latency;
+static int fu_fp_latency;
+
+//instructions each stage moves per cycle; issue_width 0 leaves issue
+//limited only by the free functional units
+static int fetch_width;
+static int dispatch_width;
+static int issue_width;
+static int commit_width;
+static int cdb_size;
+
+//reorder buffer entries; 0 for none: branches then leave at dispatch and
+//instructions are done once they leave the CDB
+static int rob_size;
+
+//load/store queue entries; 0 for none: loads and stores are then plain
+//integer FU operations and memory takes no time
+static int lsq_size;
+
+//data caches behind the LSQ and memory latency, as in sim-cache and
+//sim-outorder
+static char* cache_dl1_opt;
+static char* cache_dl2_opt;
+static int cache_dl1_lat;
+static int cache_dl2_lat;
+static int mem_nelt = 2;
+static int mem_lat[2] = { /* lat to first chunk */18, /* lat between remaining chunks */2 };
+static int mem_bus_width;
+
+//branch predictor configuration, as in sim-bpred
+static char* pred_type;
+static int bimod_nelt = 1;
+static int bimod_config[1] = { /* bimod tbl size */2048 };
+static int twolev_nelt = 4;
+static int twolev_config[4] = { /* l1size */1, /* l2size */1024, /* hist */8, /* xor */FALSE };
+static int comb_nelt = 1;
+static int comb_config[1] = { /* meta_table_size */1024 };
+static int ras_size = 8;
+static int btb_nelt = 2;
+static int btb_config[2] = { /* nsets */512, /* assoc */4 };
 
 /* IDENTIFYING INSTRUCTIONS */
 
@@ -62,8 +103,19 @@
 
 #define WRITES_CDB(op) (IS_ICOMP(op) || IS_LOAD(op) || IS_FCOMP(op))
 
+//control instruction; with a ROB these resolve on an integer FU
+#define IS_CTRL(op) (IS_COND_CTRL(op) || IS_UNCOND_CTRL(op))
+
+//load or store; with an LSQ these hold an entry until done with memory
+#define IS_MEM(op) (IS_LOAD(op) || IS_STORE(op))
+
 /* FOR DEBUGGING */
 
+//-tom:verbose levels: nothing, the table, the table and every stage transition
+#define TOM_VERBOSE_QUIET   0
+#define TOM_VERBOSE_TABLE   1
+#define TOM_VERBOSE_STAGES  2
+
 //prints info about an instruction
 #define PRINT_INST(out,instr,str,cycle)	\
   myfprintf(out, "%d: %s", cycle, str);		\
@@ -75,10 +127,19 @@
   md_print_insn(instr->inst, instr->pc, out); \
   myfprintf(stdout, "(%d)\n",instr->index);
 
+//prints a stage transition, at -tom:verbose 2
+#define TRACE_INST(instr,str,cycle) \
+  do { if (tom_verbose >= TOM_VERBOSE_STAGES) { PRINT_INST(stdout,instr,str,cycle) } } while (0)
+
 /* VARIABLES */
 
+//how much to print, and the binary pipeline log, if any
+static int tom_verbose;
+static char* tom_log_name;
+static FILE* tom_log = NULL;
+
 //instruction queue for tomasulo
-static instruction_t* instr_queue[INSTR_QUEUE_SIZE];
+static instruction_t** instr_queue;
 //number of instructions in the instruction queue
 static int instr_queue_size = 0;
 /* ECE552 Assignment 3 -BEGIN CODE*/
@@ -87,79 +148,734 @@ static int instr_queue_tail = 0;
 /* ECE552 Assignment 3 -END CODE*/
 
 
-//reservation stations (each reservation station entry contains a pointer to an instruction)
-static instruction_t* reservINT[RESERV_INT_SIZE];
-static instruction_t* reservFP[RESERV_FP_SIZE];
+//reservation stations; an instruction holds its entry from issue until it
+//leaves the CDB (stores, and loads with an LSQ: until they finish
+//executing, which computes their address), and the state of
+//the entry lives in the instruction itself (Q, wait links), so only the
+//number of entries in use is kept
+static int reserv_int_used = 0;
+static int reserv_fp_used = 0;
 
 //functional units
-static instruction_t* fuINT[FU_INT_SIZE];
-static instruction_t* fuFP[FU_FP_SIZE];
+static instruction_t** fuINT;
+static instruction_t** fuFP;
 
-//common data bus
-static instruction_t* commonDataBus = NULL;
+//instructions in a reservation station with every operand ready, as a
+//binary heap on index so the oldest is on top
+typedef struct ready_queue
+{
+  instruction_t** heap;
+  int size;
+}ready_queue_t;
+
+static ready_queue_t ready_int;
+static ready_queue_t ready_fp;
+
+//common data buses; the first cdb_used of them carry a result this cycle
+static instruction_t** commonDataBus;
+static int cdb_used = 0;
 
 //The map table keeps track of which instruction produces the value for each register
 static instruction_t* map_table[MD_TOTAL_REGS];
 
+//reorder buffer, a ring of the instructions from dispatch to commit
+static instruction_t** rob;
+static int rob_head = 0;
+static int rob_count = 0;
+
+//load/store queue, a ring of the loads and stores in program order from
+//dispatch until they are done with memory
+static instruction_t** lsq;
+static int lsq_head = 0;
+static int lsq_count = 0;
+
+//where a load in the LSQ can get its data from, see load_source
+typedef enum
+{
+  LOAD_WAIT,        //an older store may write some of its bytes
+  LOAD_FROM_STORE,  //forwarded by the youngest older store writing them
+  LOAD_FROM_CACHE
+}load_source_t;
+
+//data cache hierarchy; a NULL cache_dl1 sends every access to memory
+static struct cache_t* cache_dl1 = NULL;
+static struct cache_t* cache_dl2 = NULL;
+//the load or store accessing it, for get_PC
+static instruction_t* mem_access_instr = NULL;
+
+//direction and target predictor; NULL predicts perfectly
+static struct bpred_t* pred = NULL;
+
 //the index of the last instruction fetched
 static int fetch_index = 0;
+//set once fetch has reached the end of the trace
+static bool fetch_done = false;
+//fetch is on the wrong path until this mispredicted branch resolves, and
+//goes back to the trace from fetch_resume_cycle on
+static instruction_t* fetch_wrong_path = NULL;
+static int fetch_resume_cycle = 0;
+
+//what a cycle is charged to, see stall_cause: the first of these, from the
+//end of the pipeline, that held it back
+typedef enum
+{
+  STALL_CDB,      //a result found no free CDB
+  STALL_FU,       //an instruction with its operands found no free FU
+  STALL_ISSUE,    //an instruction with its operands and a free FU hit the issue width
+  STALL_MEM,      //nothing started executing, and loads waited for data
+  STALL_RAW,      //nothing started executing, and RS entries waited on operands
+  STALL_RS_INT,   //the IFQ head found no free integer RS
+  STALL_RS_FP,    //the IFQ head found no free floating-point RS
+  STALL_ROB,      //the IFQ head found no free ROB entry
+  STALL_LSQ,      //the IFQ head found no free LSQ entry
+  STALL_FETCH,    //fetch waited for a mispredicted branch to resolve
+  STALL_IFQ,      //fetch found the IFQ full
+  STALL_NONE,     //nothing held the pipeline back
+  STALL_NUM
+}stall_t;
+
+static char* stall_name[STALL_NUM] = {
+  "cdb", "fu", "issue", "mem", "raw", "rs_int", "rs_fp", "rob", "lsq", "fetch", "ifq", "base"
+};
+static char* stall_desc[STALL_NUM] = {
+  "cycles a result found no free CDB",
+  "cycles an instruction with its operands found no free FU",
+  "cycles an instruction with its operands and a free FU hit the issue width",
+  "cycles nothing started executing while loads waited for their data",
+  "cycles nothing started executing while RS entries waited on operands",
+  "cycles the IFQ head found no free integer RS",
+  "cycles the IFQ head found no free floating-point RS",
+  "cycles the IFQ head found no free ROB entry",
+  "cycles the IFQ head found no free LSQ entry",
+  "cycles fetch waited for a mispredicted branch to resolve",
+  "cycles fetch found the IFQ full",
+  "cycles no stage stalled"
+};
+
+//what happened in the cycle just simulated, for stall_cause
+static bool cycle_cdb_conflict = false;   //a result was left without a CDB
+static bool cycle_fu_conflict = false;    //a ready instruction was left without an FU
+static bool cycle_issue_limited = false;  //a ready instruction with a free FU was left
+static bool cycle_issued = false;         //an instruction started executing
+static bool cycle_ifq_full = false;       //fetch had an instruction but no room
+//RS entries waiting on an operand, and loads with their address waiting for data
+static int rs_waiting = 0;
+static int lsq_loads_waiting = 0;
+
+//statistics
+static counter_t tom_stall[STALL_NUM];
+static counter_t tom_num_branches = 0;
+static counter_t tom_num_mispred = 0;
+static counter_t tom_num_committed = 0;
+static counter_t tom_num_loads = 0;
+static counter_t tom_num_forwarded = 0;
+
+/* MEMORY */
+
+/* 
+ * Description: 
+ * 	Gives the latency of a main memory access, as in sim-outorder
+ * Inputs:
+ * 	blk_sz: the size of the block accessed
+ * Returns:
+ * 	The latency in cycles
+ */
+static unsigned int mem_access_latency(int blk_sz) {
+
+  int chunks = (blk_sz + (mem_bus_width - 1)) / mem_bus_width;
+
+  assert(chunks > 0);
+
+  return (/* first chunk latency */mem_lat[0] +
+          (/* remainder chunk latency */mem_lat[1] * (chunks - 1)));
+}
+
+/* 
+ * Description: 
+ * 	Handles a miss in the l1 data cache; writes go to unlimited write
+ *      buffers, and take no time
+ * Inputs:
+ *      cmd, baddr, bsize, blk, now, prefetch: see cache_create
+ * Returns:
+ * 	The latency of the block access
+ */
+static unsigned int dl1_access_fn(enum mem_cmd cmd, md_addr_t baddr, int bsize,
+                                  struct cache_blk_t* blk, tick_t now, int prefetch) {
+
+  unsigned int lat;
+
+  if (cache_dl2) {
+    lat = cache_access(cache_dl2, cmd, baddr, NULL, bsize,
+                       /* now */now, /* pudata */NULL, /* repl addr */NULL, prefetch);
+    return cmd == Read ? lat : 0;
+  }
+  return cmd == Read ? mem_access_latency(bsize) : 0;
+}
+
+/* 
+ * Description: 
+ * 	Handles a miss in the l2 data cache, see dl1_access_fn
+ * Inputs:
+ *      cmd, baddr, bsize, blk, now, prefetch: see cache_create
+ * Returns:
+ * 	The latency of the block access
+ */
+static unsigned int dl2_access_fn(enum mem_cmd cmd, md_addr_t baddr, int bsize,
+                                  struct cache_blk_t* blk, tick_t now, int prefetch) {
+
+  return cmd == Read ? mem_access_latency(bsize) : 0;
+}
+
+/* 
+ * Description: 
+ * 	Accesses the data cache hierarchy for a load or a store, at the block
+ *      holding the first byte it touches
+ * Inputs:
+ * 	cmd: Read or Write
+ *      instr: the load or store
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	The latency of the access
+ */
+static int data_access(enum mem_cmd cmd, instruction_t* instr, int current_cycle) {
+
+  int lat;
+
+  if (cache_dl1 == NULL)
+    return cmd == Read ? mem_access_latency(instr->mem_size) : 0;
+
+  mem_access_instr = instr;
+  lat = cache_access(cache_dl1, cmd, instr->mem_addr, NULL, /* nbytes */1,
+                     /* now */current_cycle, /* pudata */NULL, /* repl addr */NULL,
+                     /* !prefetch */0);
+  mem_access_instr = NULL;
+  return lat;
+}
+
+/* 
+ * Description: 
+ * 	Gives the PC of the instruction accessing the data caches, which the
+ *      PC-indexed prefetchers of cache.c ask for
+ * Inputs:
+ * 	None
+ * Returns:
+ * 	The PC, 0 outside an access
+ */
+md_addr_t get_PC() {
+
+  return mem_access_instr != NULL ? mem_access_instr->pc : 0;
+}
+
+/* 
+ * Description: 
+ * 	Registers the parameters of the machine as simulator options
+ * Inputs:
+ *      odb: the options database
+ * Returns:
+ * 	None
+ */
+void tomasulo_reg_options(struct opt_odb_t *odb) {
+
+  opt_reg_int(odb, "-tom:ifq", "instruction queue entries",
+              &ifq_size, /* default */10, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:rs_int", "integer reservation stations",
+              &reserv_int_size, /* default */4, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:rs_fp", "floating-point reservation stations",
+              &reserv_fp_size, /* default */2, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:fu_int", "integer functional units",
+              &fu_int_size, /* default */2, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:fu_fp", "floating-point functional units",
+              &fu_fp_size, /* default */1, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:lat_int", "integer functional unit latency (cycles)",
+              &fu_int_latency, /* default */4, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:lat_fp", "floating-point functional unit latency (cycles)",
+              &fu_fp_latency, /* default */9, /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:fetch:width", "instructions fetched into the IFQ per cycle",
+              &fetch_width, /* default */1, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:dispatch:width",
+              "instructions leaving the IFQ for a reservation station per cycle",
+              &dispatch_width, /* default */1, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:issue:width",
+              "instructions starting to execute per cycle (0: one per free FU)",
+              &issue_width, /* default */0, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:commit:width", "instructions committed from the ROB per cycle",
+              &commit_width, /* default */1, /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:cdb", "common data buses",
+              &cdb_size, /* default */1, /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:lsq", "load/store queue entries (0: no LSQ, no memory latency)",
+              &lsq_size, /* default */0, /* print */TRUE, /* format */NULL);
+  opt_reg_string(odb, "-tom:cache:dl1",
+                 "l1 data cache config, with an LSQ, i.e., {<config>|none}",
+                 &cache_dl1_opt, "dl1:128:32:4:l:0", /* print */TRUE, NULL);
+  opt_reg_note(odb,
+"  The cache config parameter <config> is as for sim-cache:\n"
+"\n"
+"    <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>\n"
+"\n"
+"    Examples:   -tom:cache:dl1 dl1:4096:32:1:l:1\n"
+"                -tom:cache:dl2 ul2:1024:64:2:l:0\n"
+               );
+  opt_reg_int(odb, "-tom:cache:dl1lat", "l1 data cache hit latency (in cycles)",
+              &cache_dl1_lat, /* default */1, /* print */TRUE, /* format */NULL);
+  opt_reg_string(odb, "-tom:cache:dl2",
+                 "l2 data cache config, with an LSQ, i.e., {<config>|none}",
+                 &cache_dl2_opt, "ul2:1024:64:4:l:0", /* print */TRUE, NULL);
+  opt_reg_int(odb, "-tom:cache:dl2lat", "l2 data cache hit latency (in cycles)",
+              &cache_dl2_lat, /* default */6, /* print */TRUE, /* format */NULL);
+  opt_reg_int_list(odb, "-tom:mem:lat",
+                   "memory access latency (<first_chunk> <inter_chunk>)",
+                   mem_lat, mem_nelt, &mem_nelt, mem_lat,
+                   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+  opt_reg_int(odb, "-tom:mem:width", "memory access bus width (in bytes)",
+              &mem_bus_width, /* default */8, /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:rob", "reorder buffer entries (0: no ROB, no speculation)",
+              &rob_size, /* default */0, /* print */TRUE, /* format */NULL);
+  opt_reg_string(odb, "-tom:bpred",
+                 "branch predictor, with a ROB {perfect|nottaken|taken|bimod|2lev|comb}",
+                 &pred_type, /* default */"perfect", /* print */TRUE, /* format */NULL);
+  opt_reg_int_list(odb, "-tom:bpred:bimod",
+                   "bimodal predictor config (<table size>)",
+                   bimod_config, bimod_nelt, &bimod_nelt,
+                   /* default */bimod_config,
+                   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+  opt_reg_int_list(odb, "-tom:bpred:2lev",
+                   "2-level predictor config (<l1size> <l2size> <hist_size> <xor>)",
+                   twolev_config, twolev_nelt, &twolev_nelt,
+                   /* default */twolev_config,
+                   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+  opt_reg_int_list(odb, "-tom:bpred:comb",
+                   "combining predictor config (<meta_table_size>)",
+                   comb_config, comb_nelt, &comb_nelt,
+                   /* default */comb_config,
+                   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+  opt_reg_int(odb, "-tom:bpred:ras",
+              "return address stack size (0 for no return stack)",
+              &ras_size, /* default */ras_size, /* print */TRUE, /* format */NULL);
+  opt_reg_int_list(odb, "-tom:bpred:btb",
+                   "BTB config (<num_sets> <associativity>)",
+                   btb_config, btb_nelt, &btb_nelt,
+                   /* default */btb_config,
+                   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int(odb, "-tom:verbose",
+              "0: quiet, 1: print the Tomasulo table, 2: also trace each stage",
+              &tom_verbose, /* default */TOM_VERBOSE_QUIET, /* print */TRUE, /* format */NULL);
+  opt_reg_string(odb, "-tom:log",
+                 "binary pipeline log, one record per instruction (see tomlog)",
+                 &tom_log_name, /* default */NULL, /* print */TRUE, /* format */NULL);
+}
+
+/* 
+ * Description: 
+ * 	Checks the parameters of the machine
+ * Inputs:
+ * 	None
+ * Returns:
+ * 	None
+ */
+void tomasulo_check_options(void) {
+
+  if (ifq_size < 1)
+    fatal("the instruction queue needs at least one entry");
+  if (reserv_int_size < 1 || reserv_fp_size < 1)
+    fatal("each reservation station needs at least one entry");
+  if (fu_int_size < 1 || fu_fp_size < 1)
+    fatal("each kind of functional unit needs at least one unit");
+  if (fu_int_latency < 1 || fu_fp_latency < 1)
+    fatal("functional unit latencies must be at least one cycle");
+  if (fetch_width < 1 || dispatch_width < 1 || commit_width < 1 || issue_width < 0)
+    fatal("fetch, dispatch and commit must move at least one instruction per cycle");
+  if (cdb_size < 1)
+    fatal("the machine needs at least one common data bus");
+  if (tom_verbose < TOM_VERBOSE_QUIET || tom_verbose > TOM_VERBOSE_STAGES)
+    fatal("-tom:verbose must be 0, 1 or 2");
+  if (rob_size < 0)
+    fatal("the reorder buffer cannot have a negative size");
+  if (lsq_size < 0)
+    fatal("the load/store queue cannot have a negative size");
+
+  if (lsq_size) {
+    char name[128], c;
+    int nsets, bsize, assoc, prefetch_type;
+
+    if (cache_dl1_lat < 1 || cache_dl2_lat < 1)
+      fatal("cache hit latencies must be at least one cycle");
+    if (mem_nelt != 2)
+      fatal("bad memory access latency (<first_chunk> <inter_chunk>)");
+    if (mem_lat[0] < 1 || mem_lat[1] < 1)
+      fatal("all memory access latencies must be greater than zero");
+    if (mem_bus_width < 1 || (mem_bus_width & (mem_bus_width - 1)) != 0)
+      fatal("memory bus width must be positive non-zero and a power of two");
+
+    if (!mystricmp(cache_dl1_opt, "none")) {
+      if (mystricmp(cache_dl2_opt, "none"))
+        fatal("the l1 data cache must defined if the l2 cache is defined");
+    } else {
+      if (sscanf(cache_dl1_opt, "%[^:]:%d:%d:%d:%c:%d",
+                 name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
+        fatal("bad l1 D-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
+      cache_dl1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+                               /* usize */0, assoc, cache_char2policy(c),
+                               dl1_access_fn, /* hit latency */cache_dl1_lat, prefetch_type);
+
+      if (mystricmp(cache_dl2_opt, "none")) {
+        if (sscanf(cache_dl2_opt, "%[^:]:%d:%d:%d:%c:%d",
+                   name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
+          fatal("bad l2 D-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
+        cache_dl2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+                                 /* usize */0, assoc, cache_char2policy(c),
+                                 dl2_access_fn, /* hit latency */cache_dl2_lat, prefetch_type);
+      }
+    }
+  }
+
+  if (!mystricmp(pred_type, "perfect"))
+    pred = NULL;
+  else if (!rob_size)
+    fatal("-tom:bpred %s needs a reorder buffer (-tom:rob)", pred_type);
+  else if (!mystricmp(pred_type, "taken"))
+    pred = bpred_create(BPredTaken, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  else if (!mystricmp(pred_type, "nottaken"))
+    pred = bpred_create(BPredNotTaken, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  else if (!mystricmp(pred_type, "bimod")) {
+    if (bimod_nelt != 1)
+      fatal("bad bimod predictor config (<table_size>)");
+    if (btb_nelt != 2)
+      fatal("bad btb config (<num_sets> <associativity>)");
+    pred = bpred_create(BPred2bit, bimod_config[0], 0, 0, 0, 0, 0,
+                        btb_config[0], btb_config[1], ras_size);
+  } else if (!mystricmp(pred_type, "2lev")) {
+    if (twolev_nelt != 4)
+      fatal("bad 2-level pred config (<l1size> <l2size> <hist_size> <xor>)");
+    if (btb_nelt != 2)
+      fatal("bad btb config (<num_sets> <associativity>)");
+    pred = bpred_create(BPred2Level, 0, twolev_config[0], twolev_config[1], 0,
+                        twolev_config[2], twolev_config[3],
+                        btb_config[0], btb_config[1], ras_size);
+  } else if (!mystricmp(pred_type, "comb")) {
+    if (twolev_nelt != 4)
+      fatal("bad 2-level pred config (<l1size> <l2size> <hist_size> <xor>)");
+    if (bimod_nelt != 1)
+      fatal("bad bimod predictor config (<table_size>)");
+    if (comb_nelt != 1)
+      fatal("bad combining predictor config (<meta_table_size>)");
+    if (btb_nelt != 2)
+      fatal("bad btb config (<num_sets> <associativity>)");
+    pred = bpred_create(BPredComb, bimod_config[0], twolev_config[0], twolev_config[1],
+                        comb_config[0], twolev_config[2], twolev_config[3],
+                        btb_config[0], btb_config[1], ras_size);
+  } else
+    fatal("cannot parse predictor type `%s'", pred_type);
+}
+
+/* 
+ * Description: 
+ * 	Registers the statistics of the machine
+ * Inputs:
+ *      sdb: the statistics database
+ * Returns:
+ * 	None
+ */
+void tomasulo_reg_stats(struct stat_sdb_t *sdb) {
+
+  char name[64], expr[128];
+  int i;
+
+  //the CPI stack: every cycle is charged to one cause
+  stat_reg_formula(sdb, "tom_cpi", "cycles per instruction with tomasulo",
+                   "sim_num_tom_cycles / sim_num_insn", /* format */NULL);
+  for (i = 0; i < STALL_NUM; i++) {
+    if ((!lsq_size && (i == STALL_MEM || i == STALL_LSQ)) ||
+        (!rob_size && (i == STALL_ROB || i == STALL_FETCH)) ||
+        (!issue_width && i == STALL_ISSUE))
+      continue;
+    sprintf(name, "tom_cycles_%s", stall_name[i]);
+    stat_reg_counter(sdb, name, stall_desc[i],
+                     &tom_stall[i], /* initial value */0, /* format */NULL);
+    sprintf(name, "tom_cpi_%s", stall_name[i]);
+    sprintf(expr, "tom_cycles_%s / sim_num_insn", stall_name[i]);
+    stat_reg_formula(sdb, name, "its share of tom_cpi", expr, /* format */NULL);
+  }
+
+  if (lsq_size) {
+    stat_reg_counter(sdb, "tom_num_loads",
+                     "total number of loads through the load/store queue",
+                     &tom_num_loads, /* initial value */0, /* format */NULL);
+    stat_reg_counter(sdb, "tom_num_forwarded",
+                     "total number of them forwarded from an older store",
+                     &tom_num_forwarded, /* initial value */0, /* format */NULL);
+    if (cache_dl1)
+      cache_reg_stats(cache_dl1, sdb);
+    if (cache_dl2)
+      cache_reg_stats(cache_dl2, sdb);
+  }
+
+  if (!rob_size)
+    return;
+
+  stat_reg_counter(sdb, "tom_num_committed",
+                   "total number of instructions committed by tomasulo",
+                   &tom_num_committed, /* initial value */0, /* format */NULL);
+  stat_reg_counter(sdb, "tom_num_branches",
+                   "total number of control instructions fetched by tomasulo",
+                   &tom_num_branches, /* initial value */0, /* format */NULL);
+  stat_reg_counter(sdb, "tom_num_mispred",
+                   "total number of them whose next PC was mispredicted",
+                   &tom_num_mispred, /* initial value */0, /* format */NULL);
+  stat_reg_formula(sdb, "tom_mispred_rate",
+                   "fraction of control instructions mispredicted",
+                   "tom_num_mispred / tom_num_branches", /* format */NULL);
+  if (pred)
+    bpred_reg_stats(pred, sdb);
+}
 
 /* FUNCTIONAL UNITS */
 
 
 /* RESERVATION STATIONS */
 
-
 /* 
  * Description: 
- * 	Checks if simulation is done by finishing the very last instruction
- *      Remember that simulation is done only if the entire pipeline is empty
+ * 	Adds an instruction whose operands are all ready to its ready queue
  * Inputs:
- * 	sim_insn: the total number of instructions simulated
+ * 	q: the ready queue
+ *      instr: the instruction
  * Returns:
- * 	True: if simulation is finished
+ * 	None
  */
-static bool is_simulation_done(counter_t sim_insn) {
+static void ready_push(ready_queue_t* q, instruction_t* instr) {
 
-  /* ECE552: YOUR CODE GOES HERE */
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    int i = q->size++;
+    while (i > 0 && q->heap[(i - 1) / 2]->index > instr->index) {
+        q->heap[i] = q->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    q->heap[i] = instr;
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
+/* 
+ * Description: 
+ * 	Removes the oldest instruction from a ready queue
+ * Inputs:
+ * 	q: the ready queue, not empty
+ * Returns:
+ * 	The instruction
+ */
+static instruction_t* ready_pop(ready_queue_t* q) {
 
     /* ECE552 Assignment 3 -BEGIN CODE*/
+    instruction_t* oldest = q->heap[0];
+    instruction_t* last = q->heap[--q->size];
+    int i = 0;
+    while (2 * i + 1 < q->size) {
+        int child = 2 * i + 1;
+        if (child + 1 < q->size && q->heap[child + 1]->index < q->heap[child]->index)
+            child++;
+        if (q->heap[child]->index > last->index)
+            break;
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    q->heap[i] = last;
+    return oldest;
+    /* ECE552 Assignment 3 -END CODE*/
+}
 
-    //if (fetch_index == sim_insn)
-    //    return true;
-    bool isFinished = true;
-    // check IFQ
-    if (instr_queue_size != 0) {
-        //printf("instr_queue_size: %d\n", instr_queue_size);
-        isFinished = false;
+/* 
+ * Description: 
+ * 	Points the operands of an instruction entering a reservation station at
+ *      their producers, and renames its outputs to it
+ * Inputs:
+ * 	instr: the instruction
+ * Returns:
+ * 	None
+ */
+static void set_dependences(instruction_t* instr) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    int j;
+    for (j = 0; j < 3; j++) {
+        if (instr->r_in[j] != DNA && map_table[instr->r_in[j]] != NULL) {
+            instruction_t* producer = map_table[instr->r_in[j]];
+            instr->Q[j] = producer;
+            // join the producer's list of waiting operands
+            instr->wait[j].instr = instr;
+            instr->wait[j].next = producer->waiters;
+            producer->waiters = &instr->wait[j];
+            instr->num_waiting++;
+        }
     }
-    // check RS
-    int i;
-    for (i = 0; i < RESERV_INT_SIZE; i++)
-    {
-        if (reservINT[i] != NULL) {
-            //PRINT_INST(stdout, reservINT[i], "reservINT is not empty: ", 0);
-            isFinished = false;
+    // write to map_table; only results on the CDB get renamed (a call's
+    // return address is there by dispatch)
+    for (j = 0; j < 2 && WRITES_CDB(instr->op); j++) {
+        if (instr->r_out[j] != DNA) {
+            map_table[instr->r_out[j]] = instr;
         }
     }
-    for (i = 0; i < RESERV_FP_SIZE; i++)
-    {
-        if (reservFP[i] != NULL) {
-            //PRINT_INST(stdout, reservFP[i], "reservFP is not empty: ", 0);
-            isFinished = false;
+
+    if (instr->num_waiting == 0)
+        ready_push(USES_FP_FU(instr->op) ? &ready_fp : &ready_int, instr);
+    else
+        rs_waiting++;
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
+
+/* LOAD/STORE QUEUE */
+
+/* 
+ * Description: 
+ * 	Removes the loads and stores done with memory from the head of the LSQ:
+ *      loads once on a CDB, stores once they commit (without a ROB, once
+ *      they finish executing). Stores write the cache as they leave
+ * Inputs:
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	None
+ */
+static void lsq_retire(int current_cycle) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    while (lsq_count != 0) {
+        instruction_t* instr = lsq[lsq_head];
+        if (IS_STORE(instr->op)) {
+            if (!(rob_size ? instr->done : instr->completed))
+                break;
+            data_access(Write, instr, current_cycle);
+        } else if (instr->tom_cdb_cycle == 0) {
+            break;
         }
+        lsq[lsq_head] = NULL;
+        lsq_head = (lsq_head + 1) % lsq_size;
+        lsq_count--;
     }
-    // check CDB
-    if (commonDataBus != NULL) {
-        //PRINT_INST(stdout, commonDataBus, "CDB is not empty: ", 0);
-        isFinished = false;
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
+/* 
+ * Description: 
+ * 	Finds where a load with its address computed gets its data from: the
+ *      youngest older store writing any of its bytes, if it writes all of
+ *      them, else the cache. It has to wait while an older store has not
+ *      computed its address, or writes only some of the bytes
+ * Inputs:
+ * 	pos: the position of the load from the head of the LSQ
+ * Returns:
+ * 	The source
+ */
+static load_source_t load_source(int pos) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    instruction_t* load = lsq[(lsq_head + pos) % lsq_size];
+    md_addr_t lo = load->mem_addr, hi = load->mem_addr + load->mem_size;
+
+    while (pos-- > 0) {
+        instruction_t* store = lsq[(lsq_head + pos) % lsq_size];
+        if (!IS_STORE(store->op))
+            continue;
+        if (!store->addr_ready)
+            return LOAD_WAIT;
+        if (store->mem_addr < hi && lo < store->mem_addr + store->mem_size)
+            return (store->mem_addr <= lo && hi <= store->mem_addr + store->mem_size) ?
+                LOAD_FROM_STORE : LOAD_WAIT;
+    }
+    return LOAD_FROM_CACHE;
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
+/* 
+ * Description: 
+ * 	Starts the memory access of the loads in the LSQ whose address is
+ *      computed and whose data can be had, oldest first. Forwarding from a
+ *      store takes a cycle, the cache takes its latency
+ * Inputs:
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	None
+ */
+static void LSQ_To_memory(int current_cycle) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    int i;
+    for (i = 0; i < lsq_count; i++) {
+        instruction_t* instr = lsq[(lsq_head + i) % lsq_size];
+        if (!IS_LOAD(instr->op) || !instr->addr_ready || instr->mem_ready_cycle != 0)
+            continue;
+
+        load_source_t source = load_source(i);
+        if (source == LOAD_WAIT)
+            continue;
+        tom_num_loads++;
+        if (source == LOAD_FROM_STORE) {
+            tom_num_forwarded++;
+            instr->mem_ready_cycle = current_cycle + 1;
+            TRACE_INST(instr, "forwarded: ", current_cycle);
+        } else {
+            instr->mem_ready_cycle = current_cycle + data_access(Read, instr, current_cycle);
+            TRACE_INST(instr, "memory: ", current_cycle);
+        }
     }
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
+/* 
+ * Description: 
+ * 	Checks if simulation is done by finishing the very last instruction
+ *      Remember that simulation is done only if the entire pipeline is empty
+ * Inputs:
+ * 	None; sim_num_insn belongs to the functional simulator, which may
+ *      still be running on its own thread
+ * Returns:
+ * 	True: if simulation is finished
+ */
+static bool is_simulation_done(void) {
+
+  /* ECE552: YOUR CODE GOES HERE */
 
-  return isFinished; //ECE552: you can change this as needed; we've added this so the code provided to you compiles
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+
+    // IFQ, RS (which hold the instructions in the FUs), CDB, ROB and LSQ empty
+    return instr_queue_size == 0 &&
+           reserv_int_used == 0 && reserv_fp_used == 0 &&
+           cdb_used == 0 && rob_count == 0 && lsq_count == 0;
     /* ECE552 Assignment 3 -END CODE*/
 
 }
 
+/* 
+ * Description: 
+ * 	Commits up to commit_width instructions from the head of the reorder
+ *      buffer, in order, each once it has completed in an earlier cycle
+ * Inputs:
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	None
+ */
+static void commit(int current_cycle) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    int n;
+    for (n = 0; n < commit_width && rob_count != 0 && rob[rob_head]->completed; n++) {
+        instruction_t* instr = rob[rob_head];
+        rob[rob_head] = NULL;
+        rob_head = (rob_head + 1) % rob_size;
+        rob_count--;
+
+        instr->tom_commit_cycle = current_cycle;
+        instr->done = true;
+        tom_num_committed++;
+        TRACE_INST(instr, "commit: ", current_cycle);
+    }
+    if (lsq_size)
+        lsq_retire(current_cycle);
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
 /* 
  * Description: 
  * 	Retires the instruction from writing to the Common Data Bus
@@ -173,38 +889,26 @@ void CDB_To_retire(int current_cycle) {
   /* ECE552: YOUR CODE GOES HERE */
     /* ECE552 Assignment 3 -BEGIN CODE*/
 
-    // check CDB and wait for one cycle to boardcast value
-    if (commonDataBus != NULL) {
-            int i;
-            for (i = 0; i < RESERV_INT_SIZE; i++) {
-                if (reservINT[i] == NULL) continue;
-                //PRINT_INST(stdout, reservINT[i], "reservINT: ", current_cycle);
-                //if (reservINT[i]->Q[0] != NULL)
-                //    printf("cdb index: %d, reservINT index: %d\n", commonDataBus->index, reservINT[i]->Q[0]->index);
-                //PRINT_INST(stdout, reservINT[i]->Q, "relex: ", current_cycle);
-                int j;
-                for (j = 0; j < 3; j++) {
-                    if (reservINT[i]->Q[j] != NULL &&
-                            reservINT[i]->Q[j]->index == commonDataBus->index) {
-                        reservINT[i]->Q[j] = NULL;
-                        //PRINT_INST(stdout, reservINT[i], "relex: ", current_cycle);
-                    }
-                }
-            }
-            for (i = 0; i < RESERV_FP_SIZE; i++) {
-                if (reservFP[i] == NULL) continue;
-                int j;
-                for (j = 0; j < 3; j++) {
-                    if (reservFP[i]->Q[j] != NULL &&
-                            reservFP[i]->Q[j]->index == commonDataBus->index) {
-                        reservFP[i]->Q[j] = NULL;
-                    }
-                }
+    // check CDBs and wait for one cycle to boardcast value
+    int i;
+    for (i = 0; i < cdb_used; i++) {
+        // wake up only the operands waiting on it
+        wait_link_t* link;
+        for (link = commonDataBus[i]->waiters; link != NULL; link = link->next) {
+            instruction_t* consumer = link->instr;
+            consumer->Q[link - consumer->wait] = NULL;
+            if (--consumer->num_waiting == 0) {
+                rs_waiting--;
+                ready_push(USES_FP_FU(consumer->op) ? &ready_fp : &ready_int, consumer);
             }
-        //PRINT_INST(stdout, commonDataBus, "retire CDB: ", current_cycle);
-        // retire CDB
-        commonDataBus = NULL;
+        }
+        TRACE_INST(commonDataBus[i], "retire CDB: ", current_cycle);
+        // retire CDB; with a ROB the instruction is done at commit
+        if (!rob_size)
+            commonDataBus[i]->done = true;
+        commonDataBus[i] = NULL;
     }
+    cdb_used = 0;
     /* ECE552 Assignment 3 -END CODE*/
 
 }
@@ -213,7 +917,58 @@ void CDB_To_retire(int current_cycle) {
 
 /* 
  * Description: 
- * 	Moves an instruction from the execution stage to common data bus (if possible)
+ * 	Puts an instruction that has finished executing on a free common data
+ *      bus, and releases its reservation station and functional unit
+ * Inputs:
+ * 	instr: the instruction
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	None
+ */
+static void put_on_CDB(instruction_t* instr, int current_cycle) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    instr->tom_cdb_cycle = current_cycle;
+    instr->completed = true;
+    commonDataBus[cdb_used++] = instr;
+    TRACE_INST(instr, "CDB: ", current_cycle);
+    // check if map_table tag is the same
+    // if it is the same, release it
+    int j;
+    for (j = 0; j < 2; j++) {
+        if (instr->r_out[j] != DNA &&
+                map_table[instr->r_out[j]] == instr) {
+            map_table[instr->r_out[j]] = NULL;
+        }
+    }
+    // deallocate rs and fu; a load in the LSQ left them already
+    if (lsq_size && IS_LOAD(instr->op)) {
+        lsq_loads_waiting--;
+        return;
+    } else if (USES_FP_FU(instr->op)) {
+        reserv_fp_used--;
+        for (j = 0; j < fu_fp_size; j++) {
+            if (fuFP[j] == instr) {
+                fuFP[j] = NULL;
+                break;
+            }
+        }
+    } else {
+        reserv_int_used--;
+        for (j = 0; j < fu_int_size; j++) {
+            if (fuINT[j] == instr) {
+                fuINT[j] = NULL;
+                break;
+            }
+        }
+    }
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
+/* 
+ * Description: 
+ * 	Moves instructions from the execution stage to the common data buses (if
+ *      possible); when more are done than there are buses, the oldest win
  * Inputs:
  * 	current_cycle: the cycle we are at
  * Returns:
@@ -225,112 +980,118 @@ void execute_To_CDB(int current_cycle) {
 
   /* ECE552: YOUR CODE GOES HERE */
     // check for CDB
-    if (commonDataBus != NULL)
+    if (cdb_used == cdb_size)
         return;
     
-    // check fuINT
     int i;
-    instruction_t* oldest_inst = NULL;
-
-    for (i = 0; i < FU_INT_SIZE; i++) {
-        if (fuINT[i] != NULL && (current_cycle - fuINT[i]->tom_execute_cycle >= FU_INT_LATENCY)) {
-            // special case for store
+    for (i = 0; i < fu_int_size; i++) {
+        if (fuINT[i] != NULL && (current_cycle - fuINT[i]->tom_execute_cycle >= fu_int_latency)) {
+            // special case for store, and branches with a ROB
             // no need to wait for CDB, release RS and FU
-            if (IS_STORE(fuINT[i]->op)) {
-                int j;
-                for (j = 0; j < RESERV_INT_SIZE; j++) {
-                    if (reservINT[j] != NULL && reservINT[j]->index == fuINT[i]->index) {
-                        reservINT[j] = NULL;
-                        break;
-                    }
+            if (IS_STORE(fuINT[i]->op) || IS_CTRL(fuINT[i]->op)) {
+                TRACE_INST(fuINT[i], IS_STORE(fuINT[i]->op) ? "store done: " : "branch resolved: ",
+                           current_cycle);
+                fuINT[i]->addr_ready = true;
+                fuINT[i]->completed = true;
+                if (!rob_size)
+                    fuINT[i]->done = true;
+                // a mispredicted branch sends fetch back to the trace
+                if (fuINT[i] == fetch_wrong_path) {
+                    fetch_wrong_path = NULL;
+                    fetch_resume_cycle = current_cycle + 1;
                 }
-                // release fuINT[i]
+                reserv_int_used--;
+                fuINT[i] = NULL;
+            } else if (lsq_size && IS_LOAD(fuINT[i]->op)) {
+                // the address is computed, the LSQ does the rest
+                TRACE_INST(fuINT[i], "address: ", current_cycle);
+                fuINT[i]->addr_ready = true;
+                lsq_loads_waiting++;
+                reserv_int_used--;
                 fuINT[i] = NULL;
-            } else {
-                //PRINT_INST(stdout, fuINT[i], "fuINT is ready for CDB: ", current_cycle);
+            }
+        }
+    }
+
+    // each free CDB goes to the oldest instruction done executing
+    cycle_cdb_conflict = false;
+    while (true) {
+        instruction_t* oldest_inst = NULL;
+
+        // check fuINT
+        for (i = 0; i < fu_int_size; i++) {
+            if (fuINT[i] != NULL && (current_cycle - fuINT[i]->tom_execute_cycle >= fu_int_latency)) {
                 // compete for CDB
                 if (oldest_inst == NULL || fuINT[i]->index < oldest_inst->index) {
                     oldest_inst = fuINT[i];
                 }
             }
         }
-    }
-    
-    // check fuFP
-    for (i = 0; i < FU_FP_SIZE; i++) {
-        if (fuFP[i] != NULL && (current_cycle - fuFP[i]->tom_execute_cycle >= FU_FP_LATENCY)) {
-            //PRINT_INST(stdout, fuFP[i], "fuFP is ready for CDB: ", current_cycle);
-            // compete for CDB
-            if (oldest_inst == NULL || fuFP[i]->index < oldest_inst->index) {
-                oldest_inst = fuFP[i];
-            }
-        }
-    }
-    if (oldest_inst != NULL && USES_FP_FU(oldest_inst->op)) {
-        oldest_inst->tom_cdb_cycle = current_cycle;
-        commonDataBus = oldest_inst;
-        //PRINT_INST(stdout, commonDataBus, "CDB_FP: ", current_cycle);
-        // check if map_table tag is the same
-        // if it is the same, release it
-        int j;
-        for (j = 0; j < 2; j++) {
-            if (commonDataBus->r_out[j] != DNA) {
-                if (map_table[commonDataBus->r_out[j]]->index == commonDataBus->index) {
-                    map_table[commonDataBus->r_out[j]] = NULL;
+        // check fuFP
+        for (i = 0; i < fu_fp_size; i++) {
+            if (fuFP[i] != NULL && (current_cycle - fuFP[i]->tom_execute_cycle >= fu_fp_latency)) {
+                // compete for CDB
+                if (oldest_inst == NULL || fuFP[i]->index < oldest_inst->index) {
+                    oldest_inst = fuFP[i];
                 }
             }
         }
-
-        for (j = 0; j < RESERV_FP_SIZE; j++) {
-            if (reservFP[j] != NULL && reservFP[j]->index == commonDataBus->index) {
-                reservFP[j] = NULL;
-                break;
-            }
-        }
-        // deallocate rs and fu
-        for (j = 0; j < FU_FP_SIZE; j++) {
-            if (fuFP[j] != NULL && fuFP[j]->index == commonDataBus->index) {
-                fuFP[j] = NULL;
-                break;
-            }
-        }
-
-    } else if (oldest_inst != NULL && USES_INT_FU(oldest_inst->op)) {
-        oldest_inst->tom_cdb_cycle = current_cycle;
-        commonDataBus = oldest_inst;
-        //PRINT_INST(stdout, commonDataBus, "CDB_INT: ", current_cycle);
-        int j;
-        for (j = 0; j < 2; j++) {
-            if (commonDataBus->r_out[j] != DNA) {
-                if (map_table[commonDataBus->r_out[j]] != NULL && 
-                        map_table[commonDataBus->r_out[j]]->index == commonDataBus->index) {
-                    map_table[commonDataBus->r_out[j]] = NULL;
+        // loads whose data has arrived
+        for (i = 0; i < lsq_count; i++) {
+            instruction_t* instr = lsq[(lsq_head + i) % lsq_size];
+            if (instr->mem_ready_cycle != 0 && instr->mem_ready_cycle <= current_cycle &&
+                    instr->tom_cdb_cycle == 0) {
+                if (oldest_inst == NULL || instr->index < oldest_inst->index) {
+                    oldest_inst = instr;
                 }
             }
         }
-        for (j = 0; j < RESERV_INT_SIZE; j++) {
-            if (reservINT[j] != NULL && reservINT[j]->index == commonDataBus->index) {
-                reservINT[j] = NULL;
-                break;
-            }
-        }
-        // deallocate rs and fu
-        for (j = 0; j < FU_INT_SIZE; j++) {
-            if (fuINT[j] != NULL && fuINT[j]->index == commonDataBus->index) {
-                fuINT[j] = NULL;
-                break;
-            }
+        if (oldest_inst == NULL)
+            break;
+        if (cdb_used == cdb_size) {
+            // it waits for a CDB
+            cycle_cdb_conflict = true;
+            break;
         }
+        put_on_CDB(oldest_inst, current_cycle);
     }
+    if (lsq_size)
+        lsq_retire(current_cycle);
     /* ECE552 Assignment 3 -END CODE*/
 
 }
 
+/* 
+ * Description: 
+ * 	Records why ready instructions are left waiting after issue: for
+ *      stall_cause, a kind of instruction with no free FU, or one with a
+ *      free FU that the issue width held back
+ * Inputs:
+ * 	None
+ * Returns:
+ * 	None
+ */
+static void issue_conflicts(void) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    bool free_int = false, free_fp = false;
+    int i;
+
+    for (i = 0; i < fu_int_size && !free_int; i++)
+        free_int = fuINT[i] == NULL;
+    for (i = 0; i < fu_fp_size && !free_fp; i++)
+        free_fp = fuFP[i] == NULL;
+    cycle_fu_conflict = (ready_int.size > 0 && !free_int) || (ready_fp.size > 0 && !free_fp);
+    cycle_issue_limited = (ready_int.size > 0 && free_int) || (ready_fp.size > 0 && free_fp);
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
 /* 
  * Description: 
  * 	Moves instruction(s) from the issue to the execute stage (if possible). We prioritize old instructions
  *      (in program order) over new ones, if they both contend for the same functional unit.
  *      All RAW dependences need to have been resolved with stalls before an instruction enters execute.
+ *      With an issue width, the oldest ready instructions of either kind go first
  * Inputs:
  * 	current_cycle: the cycle we are at
  * Returns:
@@ -340,83 +1101,31 @@ void issue_To_execute(int current_cycle) {
     /* ECE552 Assignment 3 -BEGIN CODE*/
 
   /* ECE552: YOUR CODE GOES HERE */
-    // check reservINT
-    instruction_t* instr_ready_queue[RESERV_INT_SIZE] = {NULL};
-    int ready_queue_head = 0;
-    int ready_queue_size = 0;
-    int i;
-    for (i = 0; i < RESERV_INT_SIZE; i++) {
-        if (reservINT[i] != NULL &&
-            reservINT[i]->Q[0] == NULL &&
-            reservINT[i]->Q[1] == NULL &&
-            reservINT[i]->Q[2] == NULL &&
-            reservINT[i]->tom_execute_cycle == 0) {
-            instr_ready_queue[ready_queue_size++] = reservINT[i];
-            //PRINT_INST(stdout, reservINT[i], "execute_INT_ready: ", current_cycle);
-        }
-    }
-    // sort ready_queue based on index
-    for (i = 0; i < ready_queue_size; i++) {
-        int j;
-        for (j = 0; j < ready_queue_size - 1; j++) {
-            // bubble sort
-            if (instr_ready_queue[j]->index > instr_ready_queue[j+1]->index) {
-                instruction_t* temp = instr_ready_queue[j+1];
-                instr_ready_queue[j+1] = instr_ready_queue[j];
-                instr_ready_queue[j] = temp;
-            }
-        }
-    }
-    // find int FU
-    if (ready_queue_size > 0) {
-        for (i = 0; i < FU_INT_SIZE; i++) {
-            if (fuINT[i] == NULL && ready_queue_head < ready_queue_size) {
-                fuINT[i] = instr_ready_queue[ready_queue_head];
-                ready_queue_head++;
-                fuINT[i]->tom_execute_cycle = current_cycle;
-                //PRINT_INST(stdout, fuINT[i], "execute_INT: ", current_cycle);
-            }
-        }
-    }
-    // FP unit case
-    for (i = 0; i < RESERV_INT_SIZE; i++) {
-        instr_ready_queue[i] = NULL;
-    }
-    ready_queue_head = 0;
-    ready_queue_size = 0;
-    for (i = 0; i < RESERV_FP_SIZE; i++) {
-        if (reservFP[i] != NULL &&
-            reservFP[i]->Q[0] == NULL &&
-            reservFP[i]->Q[1] == NULL &&
-            reservFP[i]->Q[2] == NULL &&
-            reservFP[i]->tom_execute_cycle == 0) {
-            instr_ready_queue[ready_queue_size++] = reservFP[i];
-            //PRINT_INST(stdout, reservFP[i], "execute_FP_ready: ", current_cycle);
-        }
-    }
-    // sort ready_queue based on index
-    for (i = 0; i < ready_queue_size; i++) {
-        int j;
-        for (j = 0; j < ready_queue_size - 1; j++) {
-            // bubble sort
-            if (instr_ready_queue[j]->index > instr_ready_queue[j+1]->index) {
-                instruction_t* temp = instr_ready_queue[j+1];
-                instr_ready_queue[j+1] = instr_ready_queue[j];
-                instr_ready_queue[j] = temp;
-            }
-        }
-    }
-    // find fp FU
-    if (ready_queue_size > 0) {
-        for (i = 0; i < FU_FP_SIZE; i++) {
-            if (fuFP[i] == NULL && ready_queue_head < ready_queue_size) {
-                fuFP[i] = instr_ready_queue[ready_queue_head];
-                ready_queue_head++;
-                fuFP[i]->tom_execute_cycle = current_cycle;
-                //PRINT_INST(stdout, fuFP[i], "execute_FP: ", current_cycle);
-            }
+    // free FUs take the oldest ready instructions
+    int i = 0, j = 0, n;
+    for (n = 0; issue_width == 0 || n < issue_width; n++) {
+        while (i < fu_int_size && fuINT[i] != NULL)
+            i++;
+        while (j < fu_fp_size && fuFP[j] != NULL)
+            j++;
+        bool can_int = i < fu_int_size && ready_int.size > 0;
+        bool can_fp = j < fu_fp_size && ready_fp.size > 0;
+
+        if (can_int && (!can_fp || ready_int.heap[0]->index < ready_fp.heap[0]->index)) {
+            fuINT[i] = ready_pop(&ready_int);
+            fuINT[i]->tom_execute_cycle = current_cycle;
+            TRACE_INST(fuINT[i], "execute INT: ", current_cycle);
+        } else if (can_fp) {
+            // FP unit case
+            fuFP[j] = ready_pop(&ready_fp);
+            fuFP[j]->tom_execute_cycle = current_cycle;
+            TRACE_INST(fuFP[j], "execute FP: ", current_cycle);
+        } else {
+            break;
         }
     }
+    cycle_issued = n > 0;
+    issue_conflicts();
 /* ECE552 Assignment 3 -END CODE*/
 
 } 
@@ -424,7 +1133,34 @@ void issue_To_execute(int current_cycle) {
     
 /* 
  * Description: 
- * 	Moves instruction(s) from the dispatch stage to the issue stage
+ * 	Checks if the instruction at the head of the IFQ has what it needs to
+ *      leave it: a ROB entry, if there is a ROB, an LSQ entry for a load or
+ *      store, if there is an LSQ, and a free reservation station, unless it
+ *      is a branch and there is no ROB
+ * Inputs:
+ * 	instr: the instruction
+ * Returns:
+ * 	STALL_NONE: if it can leave the IFQ this cycle, else what it lacks
+ */
+static stall_t ifq_stall(instruction_t* instr) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    if (rob_size && rob_count == rob_size)
+        return STALL_ROB;
+    if (lsq_size && IS_MEM(instr->op) && lsq_count == lsq_size)
+        return STALL_LSQ;
+    if (IS_CTRL(instr->op) && !rob_size)
+        return STALL_NONE;
+    if (USES_FP_FU(instr->op))
+        return reserv_fp_used < reserv_fp_size ? STALL_NONE : STALL_RS_FP;
+    return reserv_int_used < reserv_int_size ? STALL_NONE : STALL_RS_INT;
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
+/* 
+ * Description: 
+ * 	Moves instruction(s) from the dispatch stage to the issue stage, in
+ *      order and up to dispatch_width per cycle
  * Inputs:
  * 	current_cycle: the cycle we are at
  * Returns:
@@ -435,100 +1171,156 @@ void dispatch_To_issue(int current_cycle) {
   /* ECE552: YOUR CODE GOES HERE */
     /* ECE552 Assignment 3 -BEGIN CODE*/
 
-    instruction_t* instr_head = instr_queue[instr_queue_head];
+    int n;
+    for (n = 0; n < dispatch_width && instr_queue_size != 0; n++) {
+        instruction_t* instr_head = instr_queue[instr_queue_head];
+
+        if (ifq_stall(instr_head) != STALL_NONE)
+            return;
+        // it gets a ROB entry, in program order
+        if (rob_size)
+            rob[(rob_head + rob_count++) % rob_size] = instr_head;
+        // and loads and stores an LSQ entry
+        if (lsq_size && IS_MEM(instr_head->op))
+            lsq[(lsq_head + lsq_count++) % lsq_size] = instr_head;
+
+        // check if the head is branch op
+        if (IS_CTRL(instr_head->op) && !rob_size) {
+            // remove it from IFQ but do not issue
+            instr_head->done = true;
+            TRACE_INST(instr_head, "branch: ", current_cycle);
+        } else if (USES_FP_FU(instr_head->op)) {
+            // issue to reservFP
+            instr_head->tom_issue_cycle = current_cycle;
+            reserv_fp_used++;
+            set_dependences(instr_head);
+            TRACE_INST(instr_head, "issue FP: ", current_cycle);
+        } else {
+            // issue it to reservINT
+            instr_head->tom_issue_cycle = current_cycle;
+            reserv_int_used++;
+            set_dependences(instr_head);
+            TRACE_INST(instr_head, "issue INT: ", current_cycle);
+        }
 
-    if (instr_queue_size == 0)
-        return;
-    // check if the head is branch op
-    if (IS_COND_CTRL(instr_head->op) || IS_UNCOND_CTRL(instr_head->op)) {
-        // remove it from IFQ but do not issue
         instr_queue[instr_queue_head] = NULL;
         if (instr_queue_head != instr_queue_tail)
-            instr_queue_head = (instr_queue_head + 1) % INSTR_QUEUE_SIZE;
+            instr_queue_head = (instr_queue_head + 1) % ifq_size;
         instr_queue_size--;
-    } else if (USES_INT_FU(instr_head->op)) {
-        // check if reservINT is available
-        int i;
-        for (i = 0; i < RESERV_INT_SIZE; i++) {
-            if (reservINT[i] == NULL) {
-                break;
-            }
-        }
-
-        if (i < RESERV_INT_SIZE) {
-            // update issue cycle
-            instr_head->tom_issue_cycle = current_cycle; // modify
-            // issue it to reservINT
-            reservINT[i] = instr_head;
-            instr_queue[instr_queue_head] = NULL;
-            if (instr_queue_head != instr_queue_tail)
-                instr_queue_head = (instr_queue_head + 1) % INSTR_QUEUE_SIZE;
-            instr_queue_size--;
-
-            int j;
-            // set dependency
-            for (j = 0; j < 3; j++) {
-                if (reservINT[i]->r_in[j] != DNA) {
-                    if (map_table[reservINT[i]->r_in[j]] != NULL) {
-                        reservINT[i]->Q[j] = map_table[reservINT[i]->r_in[j]];
-                    }
-                }
-            }
-            // set tag and update map_table
-            // write to map_table
-            for (j = 0; j < 2; j++) {
-                if (reservINT[i]->r_out[j] != DNA) {
-                    map_table[reservINT[i]->r_out[j]] = reservINT[i];
-                }
-            }
+    }
+    /* ECE552 Assignment 3 -END CODE*/
 
-            
-        //PRINT_INST(stdout, instr_head, "issue INT: ", current_cycle);
-        }
-    } else if (USES_FP_FU(instr_head->op)) {
-        // check if reserv FP is available
-        int i;
-        for (i = 0; i < RESERV_FP_SIZE; i++) {
-            if (reservFP[i] == NULL) {
-                break;
-            }
-        }
+}
 
-        if (i < RESERV_FP_SIZE) {
-            // update issue cycle
-            instr_head->tom_issue_cycle = current_cycle;
-            // issue to reservFP
-            reservFP[i] = instr_head;
-            instr_queue[instr_queue_head] = NULL;
-            if (instr_queue_head != instr_queue_tail)
-                instr_queue_head = (instr_queue_head + 1) % INSTR_QUEUE_SIZE;
-            instr_queue_size--;
-            
-            int j; 
-            // set dependency
-            for (j = 0; j < 3; j++) {
-                if (reservFP[i]->r_in[j] != DNA) {
-                    if (map_table[reservFP[i]->r_in[j]] != NULL) {
-                        reservFP[i]->Q[j] = map_table[reservFP[i]->r_in[j]];
-                        //PRINT_INST(stdout, reservFP[i]->Q[j], "FP depends on: ", current_cycle);
-                    }
-                }
-            }
-            // set tag and update map_table
-            // write to map_table
-            for (j = 0; j < 2; j++) {
-                if (reservFP[i]->r_out[j] != DNA) {
-                    map_table[reservFP[i]->r_out[j]] = reservFP[i];
-                }
-            }
+/* 
+ * Description: 
+ * 	Finds the first cycle, from the given one on, at which any stage can
+ *      make progress. Until an FU finishes, a cycle in which the CDBs are free,
+ *      no FU or load result is due, no ready instruction has a free FU, no
+ *      load can access memory, the ROB head cannot commit, the IFQ head
+ *      cannot leave and fetch cannot add to the IFQ (or waits for a
+ *      redirect) leaves every stage as it was
+ * Inputs:
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	That cycle
+ */
+static int next_busy_cycle(int current_cycle) {
 
-            
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    int next = INT_MAX;
+    int free_int = 0, free_fp = 0;
+    int i;
 
-           // PRINT_INST(stdout, instr_head, "issue FP: ", current_cycle);
+    if (cdb_used != 0)
+        return current_cycle;
+    if (rob_count != 0 && rob[rob_head]->completed)
+        return current_cycle;
+    if (instr_queue_size < ifq_size && !fetch_done && fetch_wrong_path == NULL) {
+        if (current_cycle >= fetch_resume_cycle)
+            return current_cycle;
+        next = fetch_resume_cycle;
+    }
+    if (instr_queue_size != 0 && ifq_stall(instr_queue[instr_queue_head]) == STALL_NONE)
+        return current_cycle;
+
+    // the FUs: when each result is due, and whether any is free
+    for (i = 0; i < fu_int_size; i++) {
+        if (fuINT[i] == NULL)
+            free_int++;
+        else if (fuINT[i]->tom_execute_cycle + fu_int_latency < next)
+            next = fuINT[i]->tom_execute_cycle + fu_int_latency;
+    }
+    for (i = 0; i < fu_fp_size; i++) {
+        if (fuFP[i] == NULL)
+            free_fp++;
+        else if (fuFP[i]->tom_execute_cycle + fu_fp_latency < next)
+            next = fuFP[i]->tom_execute_cycle + fu_fp_latency;
+    }
+    if ((free_int && ready_int.size) || (free_fp && ready_fp.size))
+        return current_cycle;
+
+    // the loads in the LSQ: when their data arrives, and whether any can start
+    for (i = 0; i < lsq_count; i++) {
+        instruction_t* instr = lsq[(lsq_head + i) % lsq_size];
+        if (!IS_LOAD(instr->op) || !instr->addr_ready || instr->tom_cdb_cycle != 0)
+            continue;
+        if (instr->mem_ready_cycle == 0) {
+            if (load_source(i) != LOAD_WAIT)
+                return current_cycle;
+        } else if (instr->mem_ready_cycle < next) {
+            next = instr->mem_ready_cycle;
         }
     }
+
+    // nothing in flight would wake the pipeline: leave it to the caller
+    if (next == INT_MAX || next < current_cycle)
+        return current_cycle;
+    return next;
     /* ECE552 Assignment 3 -END CODE*/
+}
 
+/* 
+ * Description: 
+ * 	Predicts the next PC of a control instruction being fetched, and
+ *      trains the predictor with the one it has in the trace. On a
+ *      misprediction fetch goes down the wrong path until the instruction
+ *      resolves: the trace only holds the right one, so nothing is fetched
+ * Inputs:
+ * 	instr: the control instruction
+ * Returns:
+ * 	None
+ */
+static void predict(instruction_t* instr) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    md_addr_t pred_npc = instr->npc;
+    md_addr_t fall_through = instr->pc + sizeof(md_inst_t);
+    md_inst_t inst = instr->inst;  //MD_IS_RETURN decodes it
+
+    tom_num_branches++;
+    if (pred != NULL) {
+        struct bpred_update_t update_rec;
+        int stack_idx;
+
+        pred_npc = bpred_lookup(pred, instr->pc, instr->target, instr->op,
+                                MD_IS_CALL(instr->op), MD_IS_RETURN(instr->op),
+                                &update_rec, &stack_idx);
+        if (!pred_npc)
+            pred_npc = fall_through;
+        bpred_update(pred, instr->pc, instr->npc,
+                     /* taken? */instr->npc != fall_through,
+                     /* pred taken? */pred_npc != fall_through,
+                     /* correct pred? */pred_npc == instr->npc,
+                     instr->op, &update_rec);
+    }
+
+    if (pred_npc != instr->npc) {
+        instr->mispredicted = true;
+        tom_num_mispred++;
+        fetch_wrong_path = instr;
+    }
+    /* ECE552 Assignment 3 -END CODE*/
 }
 
 /* 
@@ -536,41 +1328,59 @@ void dispatch_To_issue(int current_cycle) {
  * 	Grabs an instruction from the instruction trace (if possible)
  * Inputs:
  *      trace: instruction trace with all the instructions executed
+ * 	current_cycle: the cycle we are at
  * Returns:
- * 	None
+ * 	True: if an instruction went into the IFQ
  */
-void fetch(instruction_trace_t* trace) {
+bool fetch(instruction_trace_t* trace, int current_cycle) {
 /* ECE552 Assignment 3 -BEGIN CODE*/
 
   /* ECE552: YOUR CODE GOES HERE */
-    // check if fetch_index bound
-    if (fetch_index + 1 > sim_num_insn)
-        return;
-
-    //first skip any TRAP instr
-    while (IS_TRAP(get_instr(trace, fetch_index + 1)->op)) {
+    //nothing from the trace while on the wrong path or redirecting
+    if (fetch_wrong_path != NULL || current_cycle < fetch_resume_cycle)
+        return false;
+
+    //first skip any TRAP instr; stop at the end of the trace
+    instruction_t* instr;
+    while ((instr = get_instr(trace, fetch_index + 1)) != NULL && IS_TRAP(instr->op)) {
+        instr->done = true;
         fetch_index++;
     }
+    if (instr == NULL) {
+        fetch_done = true;
+        return false;
+    }
+
     //check if IFQ is full
-    if (instr_queue_size < INSTR_QUEUE_SIZE) {
-        instruction_t* instr = get_instr(trace, ++fetch_index);
-        // if size is not 0, we need to increment to next slot
-        if (instr_queue_size != 0) 
-            instr_queue_tail = (instr_queue_tail + 1) % INSTR_QUEUE_SIZE;
-        // set Q to NULL
-        int i;
-        for (i = 0; i < 3; i++)
-            instr->Q[i] = NULL;
-        instr_queue[instr_queue_tail] = instr;
-        instr_queue_size++;
+    if (instr_queue_size == ifq_size) {
+        cycle_ifq_full = true;
+        return false;
     }
+
+    ++fetch_index;
+    // if size is not 0, we need to increment to next slot
+    if (instr_queue_size != 0) 
+        instr_queue_tail = (instr_queue_tail + 1) % ifq_size;
+    // set Q to NULL, nothing waiting yet
+    int i;
+    for (i = 0; i < 3; i++)
+        instr->Q[i] = NULL;
+    instr->waiters = NULL;
+    instr->num_waiting = 0;
+    instr_queue[instr_queue_tail] = instr;
+    instr_queue_size++;
+
+    if (rob_size && IS_CTRL(instr->op))
+        predict(instr);
+    return true;
     /* ECE552 Assignment 3 -END CODE*/
 
 }
 
 /* 
  * Description: 
- * 	Calls fetch and dispatches an instruction at the same cycle (if possible)
+ * 	Calls fetch and dispatches the instructions at the same cycle (if
+ *      possible), up to fetch_width of them
  * Inputs:
  *      trace: instruction trace with all the instructions executed
  * 	current_cycle: the cycle we are at
@@ -579,24 +1389,76 @@ void fetch(instruction_trace_t* trace) {
  */
 void fetch_To_dispatch(instruction_trace_t* trace, int current_cycle) {
 
-  fetch(trace);
-
   /* ECE552: YOUR CODE GOES HERE */
     /* ECE552 Assignment 3 -BEGIN CODE*/
 
-  // update dispatch cycle
-  // check if we fetch a new instr
-    //printf("instr queue size: %d, header %d, tail %d\n", instr_queue_size, instr_queue_head, instr_queue_tail); 
-    instruction_t* instr_tail = instr_queue[instr_queue_tail];
-    //md_print_insn(instr_tail->inst, instr_tail->pc, stdout);
-    if (instr_tail != NULL && instr_tail->tom_dispatch_cycle == 0) {
-        //PRINT_INST(stdout, instr_tail, "fetch: ", current_cycle);
+    int n;
+    cycle_ifq_full = false;
+    for (n = 0; n < fetch_width && fetch(trace, current_cycle); n++) {
+        // update dispatch cycle of the instr just fetched
+        instruction_t* instr_tail = instr_queue[instr_queue_tail];
+        TRACE_INST(instr_tail, "dispatch: ", current_cycle);
         instr_tail->tom_dispatch_cycle = current_cycle;
     }
      /* ECE552 Assignment 3 -END CODE*/
 
 }
 
+/* 
+ * Description: 
+ * 	Finds what held the pipeline back in the cycle just simulated: the
+ *      first stall from the end of the pipeline, so that every cycle is
+ *      charged to one cause
+ * Inputs:
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	The cause, STALL_NONE if no stage stalled
+ */
+static stall_t stall_cause(int current_cycle) {
+
+    /* ECE552 Assignment 3 -BEGIN CODE*/
+    stall_t stall;
+
+    if (cycle_cdb_conflict)
+        return STALL_CDB;
+    if (cycle_fu_conflict)
+        return STALL_FU;
+    if (cycle_issue_limited)
+        return STALL_ISSUE;
+    if (!cycle_issued && lsq_loads_waiting > 0)
+        return STALL_MEM;
+    if (!cycle_issued && rs_waiting > 0)
+        return STALL_RAW;
+    if (instr_queue_size != 0 &&
+        (stall = ifq_stall(instr_queue[instr_queue_head])) != STALL_NONE)
+        return stall;
+    if (fetch_wrong_path != NULL || current_cycle < fetch_resume_cycle)
+        return STALL_FETCH;
+    if (cycle_ifq_full)
+        return STALL_IFQ;
+    return STALL_NONE;
+    /* ECE552 Assignment 3 -END CODE*/
+}
+
+/* 
+ * Description: 
+ * 	Reports an instruction that has left the pipeline: its row of the
+ *      table and its record in the pipeline log
+ * Inputs:
+ * 	instr: the instruction
+ * Returns:
+ * 	None
+ */
+static void report_instr(instruction_t* instr) {
+
+  /* ECE552 Assignment 3 -BEGIN CODE*/
+  if (tom_verbose >= TOM_VERBOSE_TABLE)
+    print_tom_instr(instr, rob_size > 0);
+  if (tom_log != NULL)
+    write_tom_record(tom_log, instr);
+  /* ECE552 Assignment 3 -END CODE*/
+}
+
 /* 
  * Description: 
  * 	Performs a cycle-by-cycle simulation of the 4-stage pipeline
@@ -605,35 +1467,59 @@ void fetch_To_dispatch(instruction_trace_t* trace, int current_cycle) {
  * Returns:
  * 	The total number of cycles it takes to execute the instructions.
  * Extra Notes:
- * 	sim_num_insn: the number of instructions in the trace
+ * 	the trace may still be filling up; it ends at finish_instr_trace.
+ *      Each instruction's row of the table is printed once it leaves the pipeline.
+ *      With a ROB (-tom:rob) a commit stage follows the CDB, and the row
+ *      gets the commit cycle. With an LSQ (-tom:lsq) loads access memory
+ *      between execute, which computes their address, and the CDB
  */
 counter_t runTomasulo(instruction_trace_t* trace)
 {
 /* ECE552 Assignment 3 -BEGIN CODE*/
 
   //initialize instruction queue
-  int i;
-  for (i = 0; i < INSTR_QUEUE_SIZE; i++) {
-    instr_queue[i] = NULL;
-  }
+  instr_queue = calloc(ifq_size, sizeof(instruction_t*));
 
-  //initialize reservation stations
-  for (i = 0; i < RESERV_INT_SIZE; i++) {
-      reservINT[i] = NULL;
-  }
+  //initialize reservation stations and their ready queues
+  ready_int.heap = calloc(reserv_int_size, sizeof(instruction_t*));
+  ready_fp.heap = calloc(reserv_fp_size, sizeof(instruction_t*));
+
+  //initialize functional units
+  fuINT = calloc(fu_int_size, sizeof(instruction_t*));
+  fuFP = calloc(fu_fp_size, sizeof(instruction_t*));
 
-  for(i = 0; i < RESERV_FP_SIZE; i++) {
-      reservFP[i] = NULL;
+  //initialize the common data buses
+  commonDataBus = calloc(cdb_size, sizeof(instruction_t*));
+
+  //initialize the load/store queue
+  if (lsq_size) {
+    lsq = calloc(lsq_size, sizeof(instruction_t*));
+    if (!lsq)
+      fatal("out of virtual memory");
   }
 
-  //initialize functional units
-  for (i = 0; i < FU_INT_SIZE; i++) {
-    fuINT[i] = NULL;
+  //initialize the reorder buffer
+  if (rob_size) {
+    rob = calloc(rob_size, sizeof(instruction_t*));
+    if (!rob)
+      fatal("out of virtual memory");
   }
 
-  for (i = 0; i < FU_FP_SIZE; i++) {
-    fuFP[i] = NULL;
+  if (!instr_queue || !ready_int.heap || !ready_fp.heap || !fuINT || !fuFP || !commonDataBus)
+    fatal("out of virtual memory");
+
+  //set up the outputs; with neither, retiring only releases the trace
+  void (*retire)(instruction_t* instr) = NULL;
+  if (tom_log_name != NULL) {
+    tom_log = fopen(tom_log_name, "wb");
+    if (tom_log == NULL)
+      fatal("cannot open pipeline log `%s'", tom_log_name);
+    write_tom_header(tom_log, rob_size > 0);
   }
+  if (tom_verbose >= TOM_VERBOSE_TABLE)
+    fprintf(stdout, "TOMASULO TABLE\n");
+  if (tom_verbose >= TOM_VERBOSE_TABLE || tom_log != NULL)
+    retire = report_instr;
 
   //initialize map_table to no producers
   int reg;
@@ -641,23 +1527,59 @@ counter_t runTomasulo(instruction_trace_t* trace)
     map_table[reg] = NULL;
   }
   
+  //the count returned covers cycle 0 too, in which nothing moves
+  tom_stall[STALL_NONE]++;
   int cycle = 1;
   while (true) {
 
      /* ECE552: YOUR CODE GOES HERE */
      // in reverse order 
+     if (rob_size)
+        commit(cycle);
      CDB_To_retire(cycle);
      execute_To_CDB(cycle);
+     if (lsq_size)
+        LSQ_To_memory(cycle);
      issue_To_execute(cycle);
      dispatch_To_issue(cycle);
      fetch_To_dispatch(trace, cycle);
+
+     // hand back what has left the pipeline
+     retire_instr(trace, fetch_index + 1, retire);
+
+     tom_stall[stall_cause(cycle)]++;
      
      cycle++;
      //if (cycle == 30000) break;
      //printf("current_cycle: %d\n", cycle);
-     if (is_simulation_done(sim_num_insn))
+     if (is_simulation_done())
         break;
+
+     // skip cycles in which nothing can move; in them nothing issues or
+     // goes on a CDB, and ready instructions or fetch wait as they are
+     int next = next_busy_cycle(cycle);
+     if (next > cycle) {
+        cycle_cdb_conflict = false;
+        cycle_issued = false;
+        issue_conflicts();
+        cycle_ifq_full = instr_queue_size == ifq_size && !fetch_done;
+        tom_stall[stall_cause(cycle)] += next - cycle;
+        cycle = next;
+     }
   }
+  retire_instr(trace, fetch_index + 1, retire);
+
+  if (tom_log != NULL)
+    fclose(tom_log);
+
+  free(instr_queue);
+  free(ready_int.heap);
+  free(ready_fp.heap);
+  free(fuINT);
+  free(fuFP);
+  free(commonDataBus);
+  free(rob);
+  free(lsq);
   /* ECE552 Assignment 3 -END CODE*/
 
   return cycle;
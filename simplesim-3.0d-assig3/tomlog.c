@@ -0,0 +1,39 @@
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "instr.h"
+
+//turns a pipeline log written by sim-safe -tom:log into the Tomasulo
+//table that -tom:verbose 1 prints
+int main(int argc, char** argv) {
+
+  FILE* log;
+  bool commit;
+  instruction_t instr;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <pipeline log>\n", argv[0]);
+    exit(1);
+  }
+
+  log = fopen(argv[1], "rb");
+  if (log == NULL)
+    fatal("cannot open pipeline log `%s'", argv[1]);
+  if (!read_tom_header(log, &commit))
+    fatal("`%s' is not a pipeline log", argv[1]);
+
+  //md_print_insn decodes through the decoder tables
+  md_init_decoder();
+
+  fprintf(stdout, "TOMASULO TABLE\n");
+  while (read_tom_record(log, &instr))
+    print_tom_instr(&instr, commit);
+
+  fclose(log);
+  return 0;
+}
@@ -0,0 +1,105 @@
+/* cbp4.c - CBP4 branch trace writer routines */
+
+#include <stdio.h>
+#include <zlib.h>
+
+#include "host.h"
+#include "cbp4.h"
+
+/* size of a record */
+#define CBP4_RECORD_SIZE	10
+
+/* records buffered before they are compressed */
+#define CBP4_BUF_RECORDS	65536
+
+/* compressed bytes written to the file at a time */
+#define CBP4_OUT_SIZE		(1 << 20)
+
+/* trace file, NULL when closed; misc.c defines gzopen() and gzclose() of
+   its own, so the gzip stream is driven through deflate() directly */
+static FILE *cbp4_file = NULL;
+static z_stream cbp4_strm;
+static unsigned char cbp4_out[CBP4_OUT_SIZE];
+
+/* buffered records */
+static unsigned char cbp4_buf[CBP4_BUF_RECORDS * CBP4_RECORD_SIZE];
+static int cbp4_nrecords = 0;
+
+/* open FNAME for writing at gzip compression LEVEL (1-9),
+   returns non-zero on error */
+int
+cbp4_open(char *fname, int level)
+{
+  cbp4_file = fopen(fname, "wb");
+  if (!cbp4_file)
+    return 1;
+
+  cbp4_strm.zalloc = Z_NULL;
+  cbp4_strm.zfree = Z_NULL;
+  cbp4_strm.opaque = Z_NULL;
+  cbp4_nrecords = 0;
+
+  /* window bits 15 + 16: gzip header and trailer */
+  return deflateInit2(&cbp4_strm, level, Z_DEFLATED, 15 + 16, 8,
+		      Z_DEFAULT_STRATEGY) != Z_OK;
+}
+
+/* compress the buffered records, and with FLUSH == Z_FINISH end the
+   stream; returns non-zero on error */
+static int
+cbp4_deflate(int flush)
+{
+  int ret;
+
+  cbp4_strm.next_in = cbp4_buf;
+  cbp4_strm.avail_in = cbp4_nrecords * CBP4_RECORD_SIZE;
+  cbp4_nrecords = 0;
+
+  do
+    {
+      size_t bytes;
+
+      cbp4_strm.next_out = cbp4_out;
+      cbp4_strm.avail_out = CBP4_OUT_SIZE;
+      ret = deflate(&cbp4_strm, flush);
+      if (ret == Z_STREAM_ERROR)
+	return 1;
+
+      bytes = CBP4_OUT_SIZE - cbp4_strm.avail_out;
+      if (bytes && fwrite(cbp4_out, 1, bytes, cbp4_file) != bytes)
+	return 1;
+    }
+  while (cbp4_strm.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+
+  return 0;
+}
+
+/* append one record, addresses truncated to 32 bits,
+   returns non-zero on error */
+int
+cbp4_record(word_t pc, word_t target, enum cbp4_optype type, int taken)
+{
+  unsigned char *p = cbp4_buf + cbp4_nrecords * CBP4_RECORD_SIZE;
+
+  p[0] = pc; p[1] = pc >> 8; p[2] = pc >> 16; p[3] = pc >> 24;
+  p[4] = target; p[5] = target >> 8; p[6] = target >> 16; p[7] = target >> 24;
+  p[8] = type;
+  p[9] = taken != 0;
+
+  if (++cbp4_nrecords == CBP4_BUF_RECORDS)
+    return cbp4_deflate(Z_NO_FLUSH);
+  return 0;
+}
+
+/* flush and close the trace, returns non-zero on error */
+int
+cbp4_close(void)
+{
+  int err = cbp4_deflate(Z_FINISH);
+
+  deflateEnd(&cbp4_strm);
+  err |= fclose(cbp4_file) != 0;
+  cbp4_file = NULL;
+
+  return err;
+}
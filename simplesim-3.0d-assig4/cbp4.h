@@ -0,0 +1,45 @@
+/* cbp4.h - CBP4 branch trace writer interfaces */
+
+#ifndef CBP4_H
+#define CBP4_H
+
+#include "host.h"
+
+/*
+ * Writes the trace format read by CBP_TRACER in cbp4-assign2: one 10-byte
+ * record per executed instruction, PC(4) branchTarget(4) opType(1)
+ * branchTaken(1), little endian, gzip'ed in-process with zlib.  Records are
+ * buffered and compressed in large blocks.  Non-control instructions carry
+ * their own PC as target and are never taken.
+ *
+ * This module includes zlib.h, whose gzopen()/gzclose() clash with the ones
+ * misc.h declares, so it reports errors instead of calling fatal().
+ */
+
+/* CBP4 instruction classes */
+enum cbp4_optype {
+  cbp4_load = 0,		/* load */
+  cbp4_store,			/* store */
+  cbp4_op,			/* any other non-control instruction */
+  cbp4_call_direct,		/* direct call */
+  cbp4_ret,			/* return */
+  cbp4_branch_uncond,		/* direct unconditional branch or jump */
+  cbp4_branch_cond,		/* conditional branch */
+  cbp4_indirect_br_call		/* indirect branch or call */
+};
+
+/* open FNAME for writing at gzip compression LEVEL (1-9),
+   returns non-zero on error */
+int
+cbp4_open(char *fname, int level);
+
+/* append one record, addresses truncated to 32 bits,
+   returns non-zero on error */
+int
+cbp4_record(word_t pc, word_t target, enum cbp4_optype type, int taken);
+
+/* flush and close the trace, returns non-zero on error */
+int
+cbp4_close(void);
+
+#endif /* CBP4_H */
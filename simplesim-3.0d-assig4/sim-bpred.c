@@ -64,6 +64,7 @@
 #include "options.h"
 #include "stats.h"
 #include "bpred.h"
+#include "cbp4.h"
 #include "sim.h"
 
 /*
@@ -114,6 +115,15 @@ static counter_t sim_num_refs = 0;
 /* total number of branches executed */
 static counter_t sim_num_branches = 0;
 
+/* CBP4 branch trace output file name, NULL for no trace */
+static char *cbp4_fname;
+
+/* gzip compression level of the CBP4 trace */
+static int cbp4_level;
+
+/* number of records written to the CBP4 trace */
+static counter_t cbp4_num_records = 0;
+
 
 /* register simulator-specific options */
 void
@@ -179,6 +189,17 @@ sim_reg_options(struct opt_odb_t *odb)
 		   btb_config, btb_nelt, &btb_nelt,
 		   /* default */btb_config,
 		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  /* CBP4 trace capture */
+  opt_reg_string(odb, "-cbp4:trace",
+		 "write every executed instruction to this gzip'ed CBP4 trace",
+		 &cbp4_fname, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-cbp4:level",
+	      "gzip compression level of the CBP4 trace (1-9)",
+	      &cbp4_level, /* default */6,
+	      /* print */TRUE, /* format */NULL);
 }
 
 /* check simulator-specific option values */
@@ -258,6 +279,9 @@ sim_check_options(struct opt_odb_t *odb, int argc, char **argv)
     }
   else
     fatal("cannot parse predictor type `%s'", pred_type);
+
+  if (cbp4_level < 1 || cbp4_level > 9)
+    fatal("CBP4 trace compression level must be between 1 and 9");
 }
 
 /* register simulator-specific statistics */
@@ -287,6 +311,11 @@ sim_reg_stats(struct stat_sdb_t *sdb)
   /* register predictor stats */
   if (pred)
     bpred_reg_stats(pred, sdb);
+
+  if (cbp4_fname)
+    stat_reg_counter(sdb, "cbp4_num_records",
+		     "total number of records written to the CBP4 trace",
+		     &cbp4_num_records, /* initial value */0, /* format */NULL);
 }
 
 /* initialize the simulator */
@@ -301,6 +330,20 @@ sim_init(void)
   /* allocate and initialize memory space */
   mem = mem_create("mem");
   mem_init(mem);
+
+  /* open the CBP4 trace */
+  if (cbp4_fname && cbp4_open(cbp4_fname, cbp4_level))
+    fatal("cannot open CBP4 trace `%s'", cbp4_fname);
+}
+
+/* append one instruction to the CBP4 trace */
+static void
+cbp4_trace_inst(md_addr_t pc, md_addr_t target, enum cbp4_optype type,
+		int taken)
+{
+  if (cbp4_record((word_t)pc, (word_t)target, type, taken))
+    fatal("cannot write CBP4 trace `%s'", cbp4_fname);
+  cbp4_num_records++;
 }
 
 /* local machine state accessor */
@@ -348,7 +391,9 @@ sim_aux_stats(FILE *stream)		/* output stream */
 void
 sim_uninit(void)
 {
-  /* nada */
+  /* finish the CBP4 trace */
+  if (cbp4_fname && cbp4_close())
+    fatal("cannot write CBP4 trace `%s'", cbp4_fname);
 }
 
 
@@ -547,6 +592,37 @@ sim_main(void)
 	    }
 	}
 
+      /* record the instruction in the CBP4 trace: control transfers with
+	 their target and outcome, everything else with its own PC as target */
+      if (cbp4_fname)
+	{
+	  if (MD_OP_FLAGS(op) & F_CTRL)
+	    {
+	      enum cbp4_optype type;
+
+	      if (MD_IS_RETURN(op))
+		type = cbp4_ret;
+	      else if (MD_IS_CALL(op))
+		type = (MD_OP_FLAGS(op) & F_INDIRJMP)
+		  ? cbp4_indirect_br_call : cbp4_call_direct;
+	      else if (MD_OP_FLAGS(op) & F_COND)
+		type = cbp4_branch_cond;
+	      else if (MD_OP_FLAGS(op) & F_INDIRJMP)
+		type = cbp4_indirect_br_call;
+	      else
+		type = cbp4_branch_uncond;
+
+	      cbp4_trace_inst(regs.regs_PC, target_PC, type,
+			  regs.regs_NPC != (regs.regs_PC + sizeof(md_inst_t)));
+	    }
+	  else if (MD_OP_FLAGS(op) & F_MEM)
+	    cbp4_trace_inst(regs.regs_PC, regs.regs_PC,
+			(MD_OP_FLAGS(op) & F_STORE) ? cbp4_store : cbp4_load,
+			FALSE);
+	  else
+	    cbp4_trace_inst(regs.regs_PC, regs.regs_PC, cbp4_op, FALSE);
+	}
+
       /* check for DLite debugger entry condition */
       if (dlite_check_break(regs.regs_NPC,
 			    is_write ? ACCESS_WRITE : ACCESS_READ,